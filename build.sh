@@ -2,14 +2,35 @@
 
 program="test"
 
-avr-gcc -std=c99 -g -Os -mmcu=atmega328p -o ${program}.o -DF_CPU=8000000 \
+# TRACE=1 ./build.sh adds the Timer1 timing instrumentation (see trace.h)
+# SAMPLES_EEPROM=1 ./build.sh keeps unsent measurements in EEPROM (see samples.h)
+# SAMPLES_FRAMES=1 ./build.sh sends the measurements in batch frames instead of Prologue frames (see samples.h)
+# ONEWIRE_UART=1 ./build.sh runs the 1-Wire bus on USART0 (see onewire_uart.c)
+# STATS_RADIO=1 ./build.sh sends a periodic bus health frame (see stats.h)
+# ONEWIRE_FIXED_PIN=1 ./build.sh drives the bus pin of main.c directly (see onewire_timing.h)
+# F_CPU=1000000 ./build.sh runs at 1 MHz, the internal oscillator divided by 8 (L:62)
+
+F_CPU=${F_CPU:-8000000}
+
+# The gpin_t bus functions are too slow for the read slot below 8 MHz
+if [ "${F_CPU}" -lt 8000000 ] && [ -z "${ONEWIRE_UART}" ]; then
+	ONEWIRE_FIXED_PIN=1
+fi
+
+avr-gcc -std=c99 -g -Os -mmcu=atmega328p -o ${program}.o -DF_CPU=${F_CPU} ${TRACE:+-DTRACE} ${SAMPLES_EEPROM:+-DSAMPLES_EEPROM} ${SAMPLES_FRAMES:+-DSAMPLES_FRAMES} ${ONEWIRE_UART:+-DONEWIRE_UART} ${STATS_RADIO:+-DSTATS_RADIO} \
+	${ONEWIRE_FIXED_PIN:+-DONEWIRE_PORT=PORTC -DONEWIRE_PIN=PINC -DONEWIRE_DDR=DDRC -DONEWIRE_BIT=PC2} \
 	main.c \
 	crc.c \
 	pindef.c \
 	onewire.c \
+	onewire_uart.c \
 	ds18b20.c \
 	usart.c \
 	radio.c \
+	trace.c \
+	samples.c \
+	sensors.c \
+	stats.c \
 	defines.h \
  || exit 1
 
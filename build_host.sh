@@ -0,0 +1,152 @@
+#!/bin/bash
+
+# Host-side simulation builds, see host/sim.h
+# Firmware sources are compiled against the AVR replacement headers in host/
+
+mkdir -p host/bin
+
+CFLAGS="-std=gnu99 -g -O2 -Wall -DF_CPU=8000000 -Ihost -I."
+
+gcc ${CFLAGS} -o host/bin/radio_bench \
+	host/radio_bench.c \
+	host/sim.c \
+	host/ook.c \
+	radio.c \
+ || exit 1
+
+./host/bin/radio_bench || exit 1
+
+gcc ${CFLAGS} -o host/bin/gateway_bench \
+	host/gateway_bench.c \
+	host/gateway.c \
+	host/sim.c \
+	host/ook.c \
+	radio.c \
+	samples.c \
+	stats.c \
+	usart.c \
+	-lpthread \
+ || exit 1
+
+./host/bin/gateway_bench || exit 1
+
+gcc ${CFLAGS} -o host/bin/ds18b20_test \
+	host/ds18b20_test.c \
+	host/sim.c \
+	crc.c \
+	pindef.c \
+	onewire.c \
+	ds18b20.c \
+	stats.c \
+	usart.c \
+	radio.c \
+	-lm \
+ || exit 1
+
+./host/bin/ds18b20_test || exit 1
+
+# Once as flashed and once with the timing trace, checked against the
+# simulated Timer1
+for trace in "" "-DTRACE"; do
+	gcc ${CFLAGS} ${trace} -o host/bin/onewire_sim \
+		host/onewire_sim.c \
+		host/sim.c \
+		host/vcd.c \
+		host/ow_bus.c \
+		crc.c \
+		pindef.c \
+		onewire.c \
+		ds18b20.c \
+		stats.c \
+		trace.c \
+		usart.c \
+		radio.c \
+	 || exit 1
+
+	./host/bin/onewire_sim host/bin/onewire.vcd || exit 1
+done
+
+# main.c only builds for the target (it never returns), check that the
+# TRACE code in it compiles cleanly. Its string literals are plain char.
+gcc ${CFLAGS} -DTRACE -Wno-pointer-sign -fsyntax-only main.c || exit 1
+
+# The 1-Wire bus on USART0 and the software debug output
+gcc ${CFLAGS} -DONEWIRE_UART -o host/bin/onewire_uart_test \
+	host/onewire_uart_test.c \
+	host/sim.c \
+	host/vcd.c \
+	host/ow_bus.c \
+	crc.c \
+	pindef.c \
+	onewire.c \
+	onewire_uart.c \
+	ds18b20.c \
+	stats.c \
+	usart.c \
+	radio.c \
+ || exit 1
+
+./host/bin/onewire_uart_test || exit 1
+
+# The registry at a size that does not fit in the ATmega328P, once with
+# compressed and once with full ROM codes
+for layout in "" "-DSENSORS_FULL_ROM"; do
+	gcc ${CFLAGS} -DSENSORS_MAX=120 -DOW_MAX_DEVICES=128 ${layout} -o host/bin/sensors_test \
+		host/sensors_test.c \
+		host/sim.c \
+		host/vcd.c \
+		host/ow_bus.c \
+		crc.c \
+		pindef.c \
+		onewire.c \
+		ds18b20.c \
+		sensors.c \
+		stats.c \
+		usart.c \
+		radio.c \
+	 || exit 1
+
+	./host/bin/sensors_test || exit 1
+done
+
+# The measurement buffer, once with the SRAM ring only and once with the
+# EEPROM spill
+for eeprom in "" "-DSAMPLES_EEPROM"; do
+	gcc ${CFLAGS} ${eeprom} -o host/bin/samples_test \
+		host/samples_test.c \
+		host/gateway.c \
+		host/ook.c \
+		host/sim.c \
+		samples.c \
+		usart.c \
+		radio.c \
+	 || exit 1
+
+	./host/bin/samples_test || exit 1
+done
+
+# Slot and pulse timings at low and high clocks, with the fixed bus pin. Its
+# accesses cost the cycles of sbi/cbi (2) and in (1), see sim_io()
+for mhz in 1 2 4 8 16; do
+	gcc ${CFLAGS} -UF_CPU -DF_CPU=${mhz}000000UL \
+		-DONEWIRE_PORT='(*sim_io(&PORTC, 2))' -DONEWIRE_PIN='(*sim_io(&PINC, 1))' \
+		-DONEWIRE_DDR='(*sim_io(&DDRC, 2))' -DONEWIRE_BIT=PC2 \
+		-o host/bin/timing_test \
+		host/timing_test.c \
+		host/gateway.c \
+		host/ook.c \
+		host/sim.c \
+		host/vcd.c \
+		host/ow_bus.c \
+		crc.c \
+		pindef.c \
+		onewire.c \
+		ds18b20.c \
+		stats.c \
+		usart.c \
+		radio.c \
+		-lm \
+	 || exit 1
+
+	./host/bin/timing_test || exit 1
+done
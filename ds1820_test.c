@@ -1,43 +0,0 @@
-#include <stdio.h>
-
-void test(int a, int b, int c)
-{
-	float d;
-	int e;
-	
-	e = (a / 2) * 16 - 16 + (16 - c);
-	
-	d = 1.0 * (a / 2);
-	d = d - 0.25 + ((16.0 - c) / 16.0);
-	
-	printf("%d %d %d %04f %d\n", a, b, c, d, e);
-}
-
-int main()
-{
-	test(0x3b, 0x00, 0x03);
-	test(0x3b, 0x00, 0x05);
-	test(0x3b, 0x00, 0x08);
-	test(0x3a, 0x00, 0x0a);
-	test(0x3a, 0x00, 0x0c);
-	test(0x3a, 0x00, 0x0e);
-	test(0x3a, 0x00, 0x0f);
-	test(0x39, 0x00, 0x01);
-	test(0x39, 0x00, 0x02);
-	test(0x39, 0x00, 0x04);
-	test(0x39, 0x00, 0x05);
-	test(0x39, 0x00, 0x06);
-	test(0x39, 0x00, 0x07);
-	test(0x39, 0x00, 0x08);
-	test(0x38, 0x00, 0x09);
-	test(0x38, 0x00, 0x0a);
-	test(0x38, 0x00, 0x0b);
-	test(0x38, 0x00, 0x0c);
-	test(0x38, 0x00, 0x0d);
-	test(0x38, 0x00, 0x0e);
-	test(0x38, 0x00, 0x0f);
-	test(0x38, 0x00, 0x10);
-	test(0x37, 0x00, 0x01);
-	test(0x37, 0x00, 0x02);
-	return 0;
-}
\ No newline at end of file
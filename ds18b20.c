@@ -1,21 +1,123 @@
 #include "ds18b20.h"
 #include "crc.h"
 #include "onewire.h"
+#include "stats.h"
 
 // AVR
+#include <avr/pgmspace.h>
 #include <util/delay.h>
 
+// C
+#include <string.h>
+
 // Command bytes
 static const uint8_t kConvertCommand = 0x44;
 static const uint8_t kReadScatchPad = 0xBE;
+static const uint8_t kReadPowerSupply = 0xB4;
+
+// Longest conversion (12-bit resolution, DS1820), milliseconds
+#define DS18B20_CONVERSION_MS 750
+
+// Range of the decoded fast readings, 1/16 degrees C: -55C to +125C, plus
+// the quarter degree the DS1820 COUNT_REMAIN can add on either side
+#define DS18B20_MIN (-56 * 16)
+#define DS18B20_MAX (126 * 16)
+
+// Strong pull-up, see ds18b20_set_pullup()
+#ifdef ONEWIRE_UART
+static uint8_t pullupType = kDS18B20_PullupNone;
+#else
+static uint8_t pullupType = kDS18B20_PullupBusPin;
+#endif
+
+static const gpin_t* pullupPin;
 
 // Scratch pad data indexes
 static const uint8_t kScratchPad_tempLSB = 0;
 static const uint8_t kScratchPad_tempMSB = 1;
+static const uint8_t kScratchPad_config = 4;
 static const uint8_t kScratchPad_tempCountRemain = 6;
 static const uint8_t kScratchPad_crc = 8;
 
-static uint16_t ds18b20_readScratchPad(const gpin_t* io)
+/**
+ * Temperature register format of each family
+ *
+ *   T = ((raw & mask) << shift) + offset - (COUNT_REMAIN & countMask)
+ *
+ * computed on 16 bits so the sign extension of the MSB carries through.
+ * signShift reduces the MSB to its sign bit for registers where it is only
+ * a sign extension. The mask is further reduced to the resolution set in
+ * bits 6:5 of the configuration register, the resolution field is OR-ed
+ * into those bits.
+ */
+typedef struct ds18b20_format_t {
+	uint8_t family;
+	uint8_t signShift;
+	uint8_t mask;
+	uint8_t shift;
+	uint8_t offset;
+	uint8_t countMask;
+	uint8_t resolution;
+} ds18b20_format_t;
+
+static const ds18b20_format_t kFormats[] PROGMEM = {
+	// DS1820, DS18S20: 0.5C register extended with COUNT_REMAIN (COUNT_PER_C is 16)
+	// T = TEMP_READ - 0.25 + (16 - COUNT_REMAIN) / 16, TEMP_READ without bit 0
+	{ 0x10, 7, 0xFE, 3, 12, 0xFF, 0x3 },
+	
+	// DS1822
+	{ 0x22, 0, 0xFF, 0, 0, 0x00, 0x0 },
+	
+	// DS18B20, MAX31820
+	{ 0x28, 0, 0xFF, 0, 0, 0x00, 0x0 },
+	
+	// DS1825
+	{ 0x3B, 0, 0xFF, 0, 0, 0x00, 0x0 },
+	
+	// Anything else is assumed to use the DS18B20 format (must be last)
+	{ 0x00, 0, 0xFF, 0, 0, 0x00, 0x0 },
+};
+
+// Valid bits of the LSB at 9, 10, 11 and 12-bit resolution
+static const uint8_t kResolutionMask[4] PROGMEM = { 0xF8, 0xFC, 0xFE, 0xFF };
+
+static const ds18b20_format_t* ds18b20_format(uint8_t family)
+{
+	const ds18b20_format_t* format = kFormats;
+	
+	while (pgm_read_byte(&format->family) != family && pgm_read_byte(&format->family) != 0) {
+		++format;
+	}
+	
+	return format;
+}
+
+int16_t ds18b20_decode(uint8_t family, uint8_t lsb, uint8_t msb, uint8_t config, uint8_t countRemain)
+{
+	const ds18b20_format_t* format = ds18b20_format(family);
+	
+	uint8_t resolution = ((config >> 5) | pgm_read_byte(&format->resolution)) & 0x3;
+	lsb &= pgm_read_byte(&format->mask) & pgm_read_byte(&kResolutionMask[resolution]);
+	
+	msb = (uint8_t) ((int8_t) msb >> pgm_read_byte(&format->signShift));
+	
+	uint16_t raw = ((uint16_t) msb << 8) | lsb;
+	
+	return (int16_t) ((raw << pgm_read_byte(&format->shift)) + pgm_read_byte(&format->offset) -
+		(countRemain & pgm_read_byte(&format->countMask)));
+}
+
+/**
+ * Temperature from the scratch pad bytes
+ * Bytes that were not read must be left at 0xFF.
+ */
+static uint16_t ds18b20_temperature(uint8_t* buffer, uint8_t family)
+{
+	return ds18b20_decode(family, buffer[kScratchPad_tempLSB], buffer[kScratchPad_tempMSB],
+		buffer[kScratchPad_config], buffer[kScratchPad_tempCountRemain]);
+}
+
+static uint16_t ds18b20_readScratchPad(const gpin_t* io, uint8_t family, uint8_t* resolution)
 {
 	// Read scratchpad into buffer (LSB byte first)
 	static const int8_t kScratchPadLength = 9;
@@ -27,43 +129,73 @@ static uint16_t ds18b20_readScratchPad(const gpin_t* io)
 	
 	// Check the CRC (9th byte) against the 8 bytes of data
 	if (crc8(buffer, 8) != buffer[kScratchPad_crc]) {
+		STATS_INC(stats_bus.scratchPadCrcFailures);
 		return kDS18B20_CrcCheckFailed;
 	}
 	
-	// Return the raw 9 to 12-bit temperature value
-	return (buffer[kScratchPad_tempMSB] << 8) | buffer[kScratchPad_tempLSB];
+	if (resolution != NULL) {
+		*resolution = (buffer[kScratchPad_config] >> 5) & 0x3;
+	}
+	
+	return ds18b20_temperature(buffer, family);
 }
 
-static uint16_t ds18b20_readScratchPad2(const gpin_t* io, uint8_t* address)
+/**
+ * Address the device and read the first length bytes of its scratch pad
+ * The rest of the transfer is aborted with a reset.
+ */
+static bool ds18b20_readScratchPadPartial(const gpin_t* io, uint8_t* address, uint8_t* buffer, uint8_t length)
 {
-	// Read scratchpad into buffer (LSB byte first)
-	static const int8_t kScratchPadLength = 9;
-	uint8_t buffer[kScratchPadLength];
+	if (!onewire_reset(io)) {
+		return false;
+	}
 	
-	for (int8_t i = 0; i < kScratchPadLength; ++i) {
+	onewire_match_rom(io, address);
+	onewire_write(io, kReadScatchPad);
+	
+	for (uint8_t i = 0; i < length; ++i) {
 		buffer[i] = onewire_read(io);
 	}
 	
-	// Check the CRC (9th byte) against the 8 bytes of data
-	if (crc8(buffer, 8) != buffer[kScratchPad_crc]) {
-		return kDS18B20_CrcCheckFailed;
+	// The device stops sending on reset
+	onewire_reset(io);
+	
+	return true;
+}
+
+/**
+ * Check that a partial scratch pad looks like a real reading
+ */
+static bool ds18b20_plausible(uint8_t* buffer, uint8_t* address)
+{
+	uint8_t msb = buffer[kScratchPad_tempMSB];
+	uint8_t lsb = buffer[kScratchPad_tempLSB];
+	
+	// An empty bus reads as all ones
+	if (msb == 0xFF && lsb == 0xFF) {
+		return false;
 	}
 	
-	// DS1820, DS18S20
-	if (address[0] == 0x10)
-	{
-		// temp_read - 0.25 + (count_per_c - count_remain) / count_per_c
-		// count_per_c is always 16 (0x10)
+	if (address[0] == 0x10) {
+		// Sign extended 9-bit value, -55C to +125C, COUNT_REMAIN is 1..16
+		uint8_t countRemain = buffer[kScratchPad_tempCountRemain];
 		
-		// Return the raw 9 to 12-bit temperature value
-		return ((buffer[kScratchPad_tempLSB] >> 1) << 4) - 16 +
-			(16 - (buffer[kScratchPad_tempCountRemain]));
-	}
-	else
-	{
-		// Return the raw 9 to 12-bit temperature value
-		return (buffer[kScratchPad_tempMSB] << 8) | buffer[kScratchPad_tempLSB];
+		if (countRemain == 0 || countRemain > 16) {
+			return false;
+		}
+		
+		// The 85C power-on value, a converted 85C has another COUNT_REMAIN
+		if (msb == 0x00 && lsb == 0xAA && countRemain == 0x0C) {
+			return false;
+		}
+		
+		return (msb == 0x00 && lsb <= 250) || (msb == 0xFF && lsb >= 146);
 	}
+	
+	// Sign extended 12-bit value, -55C to +125C, except the 85C power-on value
+	int16_t raw = (msb << 8) | lsb;
+	
+	return raw >= -55 * 16 && raw <= 125 * 16 && raw != 0x0550;
 }
 
 uint16_t ds18b20_read_single(const gpin_t* io)
@@ -77,22 +209,151 @@ uint16_t ds18b20_read_single(const gpin_t* io)
 	onewire_skiprom(io);
 	onewire_write(io, kReadScatchPad);
 	
-	// Read the data from the scratch pad
-	return ds18b20_readScratchPad(io);
+	// Read the data from the scratch pad, the family is not known
+	return ds18b20_readScratchPad(io, 0x28, NULL);
 }
 
 uint16_t ds18b20_read_slave(const gpin_t* io, uint8_t* address)
+{
+	return ds18b20_read_slave_mode(io, address, kDS18B20_ReadFull, NULL);
+}
+
+uint16_t ds18b20_read_slave_mode(const gpin_t* io, uint8_t* address, uint8_t mode, uint8_t* resolution)
+{
+	// Bytes needed for the temperature
+	uint8_t length = (address[0] == 0x10) ? kScratchPad_tempCountRemain + 1 : kScratchPad_tempMSB + 1;
+	uint8_t buffer[kScratchPad_tempCountRemain + 1];
+	
+	if (mode == kDS18B20_ReadFull) {
+		// Confirm the device is still alive. Abort if no reply
+		if (!onewire_reset(io)) {
+			return kDS18B20_DeviceNotFound;
+		}
+		
+		onewire_match_rom(io, address);
+		onewire_write(io, kReadScatchPad);
+		
+		// Read the data from the scratch pad
+		return ds18b20_readScratchPad(io, address[0], resolution);
+	}
+	
+	// The configuration register is not read, decode at the known resolution
+	memset(buffer, 0xFF, sizeof(buffer));
+	buffer[kScratchPad_config] = ((resolution != NULL ? *resolution : 3) << 5) | 0x1F;
+	
+	if (!ds18b20_readScratchPadPartial(io, address, buffer, length)) {
+		return kDS18B20_DeviceNotFound;
+	}
+	
+	if (!ds18b20_plausible(buffer, address)) {
+		return kDS18B20_ValidationFailed;
+	}
+	
+	// Out of range values would also collide with the special return values
+	int16_t temperature = ds18b20_temperature(buffer, address[0]);
+	
+	if (temperature < DS18B20_MIN || temperature > DS18B20_MAX) {
+		return kDS18B20_ValidationFailed;
+	}
+	
+	return temperature;
+}
+
+void ds18b20_set_pullup(uint8_t type, const gpin_t* mosfet)
+{
+	pullupType = type;
+	pullupPin = mosfet;
+	
+	if (type == kDS18B20_PullupMosfet) {
+		// Switched off
+		gset_output_high(mosfet);
+		gset_output(mosfet);
+	}
+}
+
+static void ds18b20_pullup(const gpin_t* io, bool on)
+{
+#ifndef ONEWIRE_UART
+	if (on && pullupType == kDS18B20_PullupBusPin) {
+		gset_output_high(io);
+		gset_output(io);
+	} else {
+		// Leave the bus to the pull-up resistor and the MOSFET
+		gset_input_hiz(io);
+	}
+#endif
+	
+	if (pullupType == kDS18B20_PullupMosfet) {
+		if (on) {
+			gset_output_low(pullupPin);
+		} else {
+			gset_output_high(pullupPin);
+		}
+	}
+}
+
+bool ds18b20_parasite(const gpin_t* io, uint8_t* address)
+{
+	if (!onewire_reset(io)) {
+		return false;
+	}
+	
+	if (address == NULL) {
+		onewire_skiprom(io);
+	} else {
+		onewire_match_rom(io, address);
+	}
+	
+	onewire_write(io, kReadPowerSupply);
+	
+	// Parasite powered devices pull the bus low
+	return onewire_read_bit(io) == 0;
+}
+
+uint8_t ds18b20_strategy(const gpin_t* io)
+{
+	if (!ds18b20_parasite(io, NULL)) {
+		return kDS18B20_ConvertParallel;
+	}
+	
+	if (pullupType != kDS18B20_PullupNone) {
+		return kDS18B20_ConvertParallelPullup;
+	}
+	
+	return kDS18B20_ConvertSequential;
+}
+
+uint16_t ds18b20_convert_wait(const gpin_t* io, uint8_t* address, uint8_t strategy)
 {
 	// Confirm the device is still alive. Abort if no reply
 	if (!onewire_reset(io)) {
 		return kDS18B20_DeviceNotFound;
 	}
 	
-	onewire_match_rom(io, address);
-	onewire_write(io, kReadScatchPad);
+	if (address == NULL) {
+		onewire_skiprom(io);
+	} else {
+		onewire_match_rom(io, address);
+	}
 	
-	// Read the data from the scratch pad
-	return ds18b20_readScratchPad2(io, address);
+	onewire_write(io, kConvertCommand);
+	
+	if (strategy == kDS18B20_ConvertParallel) {
+		// Devices answer read slots with 0 until the conversion is done
+		for (uint16_t ms = 0; ms < DS18B20_CONVERSION_MS && !onewire_read_bit(io); ++ms) {
+			_delay_ms(1);
+		}
+		
+		return 0;
+	}
+	
+	// Parasite devices take their power from the bus, it must stay high
+	// (strong pull-up within 10uS of the command) until the end
+	ds18b20_pullup(io, true);
+	_delay_ms(DS18B20_CONVERSION_MS);
+	ds18b20_pullup(io, false);
+	
+	return 0;
 }
 
 uint16_t ds18b20_convert(const gpin_t* io)
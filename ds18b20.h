@@ -3,11 +3,87 @@
 #include "pindef.h"
 
 // C
+#include <stdbool.h>
 #include <stdint.h>
 
 // Special return values
 static const uint16_t kDS18B20_DeviceNotFound = 0xA800;
 static const uint16_t kDS18B20_CrcCheckFailed = 0x5000;
+static const uint16_t kDS18B20_ValidationFailed = 0x5800;
+
+/**
+ * Ways of reading the scratch pad, see ds18b20_read_slave_mode()
+ *
+ * Addressing a device costs 80 slots (Match ROM and Read Scratch Pad), so a
+ * DS18B20 read is 152 slots in full mode and 96 in plausible mode. Reading
+ * the temperature twice to compare it would need a second addressing and
+ * cost more than the full read.
+ */
+enum {
+	// Read all 9 bytes and check the CRC (72 read slots)
+	kDS18B20_ReadFull,
+	
+	// Read only the temperature (16 slots, 56 for the DS1820 which also needs
+	// COUNT_REMAIN), stop the device with a reset and check that the value is
+	// plausible: -55C to +125C, not all ones and not the 85C power-on value
+	// (0x0550, or 0x00AA with COUNT_REMAIN 0x0C on the DS1820)
+	kDS18B20_ReadFastPlausible,
+};
+
+/**
+ * Strong pull-up used to power parasite devices during a conversion
+ */
+enum {
+	// Only the pull-up resistor (default with the USART backend)
+	kDS18B20_PullupNone,
+	
+	// Drive the bus pin high (default with the software backend)
+	kDS18B20_PullupBusPin,
+	
+	// A P-channel MOSFET from VCC to the bus, switched on by driving its gate pin low
+	kDS18B20_PullupMosfet,
+};
+
+/**
+ * How ds18b20_convert_wait() powers a conversion
+ */
+enum {
+	// All devices externally powered: convert together, poll for the end
+	kDS18B20_ConvertParallel,
+	
+	// Parasite devices and a strong pull-up: convert together with the bus held high
+	kDS18B20_ConvertParallelPullup,
+	
+	// Parasite devices without a strong pull-up: the resistor can only power
+	// one conversion, so devices must be converted one at a time
+	kDS18B20_ConvertSequential,
+};
+
+/**
+ * Select the strong pull-up, mosfet is the gate pin for kDS18B20_PullupMosfet
+ */
+void ds18b20_set_pullup(uint8_t type, const gpin_t* mosfet);
+
+/**
+ * Ask a device (or all devices if address is NULL) how it is powered
+ * @returns true if a device is parasite powered (Read Power Supply)
+ */
+bool ds18b20_parasite(const gpin_t* io, uint8_t* address);
+
+/**
+ * Fastest safe conversion strategy for the devices on the bus
+ */
+uint8_t ds18b20_strategy(const gpin_t* io);
+
+/**
+ * Convert on one device (or all devices if address is NULL) and return
+ * once the result is ready
+ *
+ * Parasite powered devices get the strong pull-up for the whole conversion
+ * time (750ms), externally powered ones are polled and return as soon as
+ * they are done. Use kDS18B20_ConvertSequential with one address at a time.
+ */
+uint16_t ds18b20_convert_wait(const gpin_t* io, uint8_t* address, uint8_t strategy);
 
 /**
  * Trigger all devices on the bus to perform a temperature reading
@@ -36,3 +112,27 @@ uint16_t ds18b20_read_single(const gpin_t* io);
  * Address must be a an array of 8 bytes (uint8_t[8])
  */
 uint16_t ds18b20_read_slave(const gpin_t* io, uint8_t* address);
+
+/**
+ * Convert the scratch pad temperature to 1/16 degrees C
+ *
+ * Handles the DS1820/DS18S20 (0x10) extended resolution with COUNT_REMAIN
+ * and the 12-bit format of the DS1822 (0x22), DS18B20/MAX31820 (0x28) and
+ * DS1825 (0x3B), whose undefined low bits are cleared according to the
+ * resolution in the configuration register. Other families are decoded as
+ * a DS18B20.
+ */
+int16_t ds18b20_decode(uint8_t family, uint8_t lsb, uint8_t msb, uint8_t config, uint8_t countRemain);
+
+/**
+ * Read the last temperature conversion from a specific probe
+ *
+ * The fast modes do not check the CRC, so they are meant for short and
+ * healthy buses. They return kDS18B20_ValidationFailed if the reading
+ * can't be trusted or is out of the -55C to +125C range.
+ *
+ * They don't read the configuration register either: resolution (0 for 9
+ * bits to 3 for 12 bits) is the one the last full read stored there, NULL
+ * decodes at 12 bits.
+ */
+uint16_t ds18b20_read_slave_mode(const gpin_t* io, uint8_t* address, uint8_t mode, uint8_t* resolution);
@@ -0,0 +1,35 @@
+#pragma once
+
+// Host build replacement for <avr/eeprom.h>
+// The EEPROM is an array in sim.c, erased (0xFF) by sim_eeprom_erase()
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define E2END 0x3FF
+
+extern uint8_t sim_eeprom[E2END + 1];
+
+static inline uint8_t eeprom_read_byte(const uint8_t* addr)
+{
+    return sim_eeprom[(uintptr_t) addr];
+}
+
+static inline void eeprom_update_byte(uint8_t* addr, uint8_t value)
+{
+    sim_eeprom[(uintptr_t) addr] = value;
+}
+
+static inline void eeprom_read_block(void* dst, const void* src, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        ((uint8_t*) dst)[i] = sim_eeprom[(uintptr_t) src + i];
+    }
+}
+
+static inline void eeprom_update_block(const void* src, void* dst, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        sim_eeprom[(uintptr_t) dst + i] = ((const uint8_t*) src)[i];
+    }
+}
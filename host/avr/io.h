@@ -0,0 +1,79 @@
+#pragma once
+
+// Host build replacement for <avr/io.h>
+// I/O registers are plain variables owned by the simulator (sim.c)
+
+#include <stdint.h>
+
+#define _BV(bit) (1 << (bit))
+
+extern volatile uint8_t PORTB, PINB, DDRB;
+extern volatile uint8_t PORTC, PINC, DDRC;
+extern volatile uint8_t PORTD, PIND, DDRD;
+
+// Status register, only the global interrupt flag is used (see util/atomic.h)
+extern volatile uint8_t SREG;
+
+#define SREG_I 7
+
+// USART0. The status and data registers are accessed through sim.c, which
+// runs the USART model on every access (see sim_usart_connect())
+extern volatile uint8_t UCSR0B, UCSR0C, UBRR0H, UBRR0L;
+
+volatile uint8_t* sim_usart_status(void);
+volatile uint8_t* sim_usart_data(void);
+
+#define UCSR0A (*sim_usart_status())
+#define UDR0 (*sim_usart_data())
+
+// A register reached through an I/O instruction of the given cost: the clock
+// advances first, so the edge or the sample lands at the end of the
+// instruction. Builds that charge the pin accesses map the bus pin through
+// it, e.g. -DONEWIRE_DDR='(*sim_io(&DDRC, 2))' (see sim_io_watch())
+volatile uint8_t* sim_io(volatile uint8_t* reg, uint8_t cycles);
+
+#define RXC0 7
+#define TXC0 6
+#define UDRE0 5
+#define U2X0 1
+#define RXCIE0 7
+#define TXCIE0 6
+#define UDRIE0 5
+#define RXEN0 4
+#define TXEN0 3
+#define USBS0 3
+#define UCSZ00 1
+
+// Timer1
+extern volatile uint8_t TCCR1A, TCCR1B;
+extern volatile uint16_t TCNT1;
+
+#define CS10 0
+#define CS11 1
+#define CS12 2
+
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define PB6 6
+#define PB7 7
+
+#define PC0 0
+#define PC1 1
+#define PC2 2
+#define PC3 3
+#define PC4 4
+#define PC5 5
+#define PC6 6
+
+#define PD0 0
+#define PD1 1
+#define PD2 2
+#define PD3 3
+#define PD4 4
+#define PD5 5
+#define PD6 6
+#define PD7 7
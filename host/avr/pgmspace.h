@@ -0,0 +1,14 @@
+#pragma once
+
+// Host build replacement for <avr/pgmspace.h>
+// There is a single address space on the host, so flash reads are plain reads
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+
+#define pgm_read_byte(addr) (*(const uint8_t*) (addr))
+#define pgm_read_word(addr) (*(const uint16_t*) (addr))
+#define memcpy_P(dest, src, n) memcpy((dest), (src), (n))
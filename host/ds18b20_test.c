@@ -0,0 +1,116 @@
+// Exhaustive check and benchmark of ds18b20_decode()
+//
+// Every LSB/MSB pair is decoded for each family, at every resolution for the
+// 12-bit families and with every valid COUNT_REMAIN for the DS1820, and
+// compared with the datasheet formulas evaluated in floating point.
+
+#include "ds18b20.h"
+
+// C
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+#define BENCH_ROUNDS 200
+
+static const uint8_t families[] = { 0x22, 0x28, 0x3B };
+
+/**
+ * DS1820: T = TEMP_READ - 0.25 + (COUNT_PER_C - COUNT_REMAIN) / COUNT_PER_C
+ * TEMP_READ is the 0.5C register with bit 0 truncated, the MSB is only a sign
+ */
+static double reference_ds1820(uint16_t raw, uint8_t countRemain)
+{
+    int value = (raw & 0x8000) ? (raw & 0xFF) - 256 : (raw & 0xFF);
+    double tempRead = floor(value / 2.0);
+
+    return tempRead - 0.25 + (16.0 - countRemain) / 16.0;
+}
+
+/**
+ * DS18B20: 1/16 degree register, the bits below the resolution are undefined
+ */
+static double reference_ds18b20(uint16_t raw, uint8_t resolution)
+{
+    double step = 1.0 / (2 << resolution);
+
+    return floor((int16_t) raw / 16.0 / step) * step;
+}
+
+static int check_ds1820(void)
+{
+    int failures = 0;
+
+    for (uint32_t raw = 0; raw <= 0xFFFF; ++raw) {
+        for (uint8_t countRemain = 1; countRemain <= 16; ++countRemain) {
+            int16_t value = ds18b20_decode(0x10, raw & 0xFF, raw >> 8, 0xFF, countRemain);
+            double expected = reference_ds1820(raw, countRemain);
+
+            if (value / 16.0 != expected && failures++ < 10) {
+                printf("FAIL family 10 raw=%04x count_remain=%u: %.4f, expected %.4f\n",
+                    raw, countRemain, value / 16.0, expected);
+            }
+        }
+    }
+
+    return failures;
+}
+
+static int check_ds18b20(uint8_t family)
+{
+    int failures = 0;
+
+    for (uint8_t resolution = 0; resolution < 4; ++resolution) {
+        // Reserved configuration bits read as ones
+        uint8_t config = 0x1F | (resolution << 5);
+
+        for (uint32_t raw = 0; raw <= 0xFFFF; ++raw) {
+            int16_t value = ds18b20_decode(family, raw & 0xFF, raw >> 8, config, 0x0C);
+            double expected = reference_ds18b20(raw, resolution);
+
+            if (value / 16.0 != expected && failures++ < 10) {
+                printf("FAIL family %02x raw=%04x config=%02x: %.4f, expected %.4f\n",
+                    family, raw, config, value / 16.0, expected);
+            }
+        }
+    }
+
+    return failures;
+}
+
+static void bench(const char* name, uint8_t family, uint8_t config)
+{
+    struct timespec start, end;
+    volatile int16_t sink = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int round = 0; round < BENCH_ROUNDS; ++round) {
+        for (uint32_t raw = 0; raw <= 0xFFFF; ++raw) {
+            sink += ds18b20_decode(family, raw & 0xFF, raw >> 8, config, raw & 0x0F);
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    printf("%-10s %6.2f ns/decode\n", name, seconds * 1e9 / (BENCH_ROUNDS * 65536.0));
+}
+
+int main(void)
+{
+    int failures = check_ds1820();
+
+    for (unsigned i = 0; i < sizeof(families) / sizeof(families[0]); ++i) {
+        failures += check_ds18b20(families[i]);
+    }
+
+    printf("ds18x20 decode: %s\n\n", failures ? "FAIL" : "ok");
+
+    bench("ds1820", 0x10, 0xFF);
+    bench("ds18b20", 0x28, 0x7F);
+    bench("ds1825", 0x3B, 0x1F);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,379 @@
+#include "gateway.h"
+
+#include "samples.h"
+#include "stats.h"
+
+// C
+#include <stdlib.h>
+#include <string.h>
+
+bool gateway_readings_alloc(gateway_readings* readings, size_t capacity)
+{
+    memset(readings, 0, sizeof(*readings));
+
+    readings->capacity = capacity;
+    readings->id = malloc(capacity);
+    readings->channel = malloc(capacity);
+    readings->flags = malloc(capacity);
+    readings->humidity = malloc(capacity);
+    readings->temperature = malloc(capacity * sizeof(int16_t));
+    readings->rom = malloc(capacity * sizeof(uint64_t));
+    readings->age = malloc(capacity * sizeof(uint16_t));
+
+    if (!readings->id || !readings->channel || !readings->flags || !readings->humidity ||
+        !readings->temperature || !readings->rom || !readings->age) {
+        gateway_readings_free(readings);
+        return false;
+    }
+
+    return true;
+}
+
+void gateway_readings_free(gateway_readings* readings)
+{
+    free(readings->id);
+    free(readings->channel);
+    free(readings->flags);
+    free(readings->humidity);
+    free(readings->temperature);
+    free(readings->rom);
+    free(readings->age);
+
+    memset(readings, 0, sizeof(*readings));
+}
+
+bool gateway_health_alloc(gateway_health* health, size_t capacity)
+{
+    memset(health, 0, sizeof(*health));
+
+    health->capacity = capacity;
+    health->id = malloc(capacity);
+    health->flags = malloc(capacity);
+    health->presenceFailures = malloc(capacity);
+    health->crcFailures = malloc(capacity);
+    health->retries = malloc(capacity);
+
+    if (!health->id || !health->flags || !health->presenceFailures || !health->crcFailures ||
+        !health->retries) {
+        gateway_health_free(health);
+        return false;
+    }
+
+    return true;
+}
+
+void gateway_health_free(gateway_health* health)
+{
+    free(health->id);
+    free(health->flags);
+    free(health->presenceFailures);
+    free(health->crcFailures);
+    free(health->retries);
+
+    memset(health, 0, sizeof(*health));
+}
+
+void gateway_readings_slice(const gateway_readings* readings, size_t first, size_t length, gateway_readings* slice)
+{
+    slice->count = 0;
+    slice->capacity = length;
+    slice->id = readings->id + first;
+    slice->channel = readings->channel + first;
+    slice->flags = readings->flags + first;
+    slice->humidity = readings->humidity + first;
+    slice->temperature = readings->temperature + first;
+    slice->rom = readings->rom + first;
+    slice->age = readings->age + first;
+}
+
+uint64_t gateway_pack(const uint8_t* bytes, uint8_t length)
+{
+    uint64_t frame = 0;
+
+    for (uint8_t i = 0; i < (length + 7) / 8 && i < 8; ++i) {
+        frame |= (uint64_t) bytes[i] << (56 - 8 * i);
+    }
+
+    // Clear the bits past the end of the frame
+    return length >= 64 ? frame : frame & ~(UINT64_MAX >> length);
+}
+
+// What the rtl_433 decoders require of a capture: the timings, the number
+// of identical rows and their length. Batch frames are sent 3 times without
+// a checksum, two identical rows stand for one.
+static const struct {
+    const ook_ppm_timing* timing;
+    uint8_t repeats;
+    uint8_t minBits;
+    uint8_t maxBits;
+} captures[] = {
+    [kGatewayPrologue] = { &ook_timing_prologue, 4, 36, 37 },
+    [kGatewayNexus] = { &ook_timing_nexus, 3, 36, 36 },
+    [kGatewayBatch] = { &ook_timing_prologue, 2, 64, 64 },
+    [kGatewayHealth] = { &ook_timing_prologue, 4, 36, 37 },
+};
+
+bool gateway_capture_frame(const ook_pulses* pulses, gateway_protocol protocol, uint64_t* frame)
+{
+    ook_bits bits;
+
+    ook_demod_ppm(pulses, captures[protocol].timing, &bits);
+
+    if (bits.timing_errors != 0) {
+        return false;
+    }
+
+    int row = ook_find_repeated_row(&bits, captures[protocol].repeats, captures[protocol].minBits);
+
+    if (row < 0 || bits.bits[row] > captures[protocol].maxBits) {
+        return false;
+    }
+
+    *frame = gateway_pack(bits.data[row], bits.bits[row]);
+
+    return true;
+}
+
+/**
+ * Room left in readings, limited to count
+ */
+static size_t gateway_room(const gateway_readings* readings, size_t count)
+{
+    size_t room = readings->capacity - readings->count;
+
+    return count < room ? count : room;
+}
+
+size_t gateway_decode_prologue(const uint64_t* frames, size_t count, gateway_readings* readings)
+{
+    size_t n = gateway_room(readings, count);
+    size_t base = readings->count;
+
+    uint8_t* restrict id = readings->id + base;
+    uint8_t* restrict channel = readings->channel + base;
+    uint8_t* restrict flags = readings->flags + base;
+    uint8_t* restrict humidity = readings->humidity + base;
+    int16_t* restrict temperature = readings->temperature + base;
+    uint64_t* restrict rom = readings->rom + base;
+    uint16_t* restrict age = readings->age + base;
+
+    // type:4 id:8 battery:1 button:1 channel:2 temperature:12 humidity:8 (:1)
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t f = frames[i];
+        uint8_t type = f >> 60;
+
+        id[i] = f >> 52;
+        channel[i] = ((f >> 48) & 0x3) + 1;
+        temperature[i] = (int16_t) ((f >> 32) & 0xFFF0) >> 4;
+        humidity[i] = f >> 28;
+        rom[i] = 0;
+        age[i] = 0;
+
+        // Type 9 for the original sensor, 5 for the newer variant
+        flags[i] = ((type == 9) | (type == 5)) * GATEWAY_VALID |
+            ((f >> 51) & 0x1) * GATEWAY_BATTERY_OK |
+            ((f >> 50) & 0x1) * GATEWAY_BUTTON;
+    }
+
+    readings->count += n;
+
+    return n;
+}
+
+size_t gateway_decode_nexus(const uint64_t* frames, size_t count, gateway_readings* readings)
+{
+    size_t n = gateway_room(readings, count);
+    size_t base = readings->count;
+
+    uint8_t* restrict id = readings->id + base;
+    uint8_t* restrict channel = readings->channel + base;
+    uint8_t* restrict flags = readings->flags + base;
+    uint8_t* restrict humidity = readings->humidity + base;
+    int16_t* restrict temperature = readings->temperature + base;
+    uint64_t* restrict rom = readings->rom + base;
+    uint16_t* restrict age = readings->age + base;
+
+    // id:8 battery:1 :1 channel:2 temperature:12 constant:4 humidity:8
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t f = frames[i];
+
+        id[i] = f >> 56;
+        channel[i] = ((f >> 52) & 0x3) + 1;
+        temperature[i] = (int16_t) ((f >> 36) & 0xFFF0) >> 4;
+        humidity[i] = f >> 28;
+        rom[i] = 0;
+        age[i] = 0;
+
+        // The constant nibble is all ones
+        flags[i] = (((f >> 36) & 0xF) == 0xF) * GATEWAY_VALID |
+            ((f >> 55) & 0x1) * GATEWAY_BATTERY_OK;
+    }
+
+    readings->count += n;
+
+    return n;
+}
+
+size_t gateway_decode_batch(const uint64_t* frames, size_t count, gateway_readings* readings)
+{
+    size_t n = gateway_room(readings, 2 * count) / 2;
+    size_t base = readings->count;
+
+    uint8_t* restrict id = readings->id + base;
+    uint8_t* restrict channel = readings->channel + base;
+    uint8_t* restrict flags = readings->flags + base;
+    uint8_t* restrict humidity = readings->humidity + base;
+    int16_t* restrict temperature = readings->temperature + base;
+    uint64_t* restrict rom = readings->rom + base;
+    uint16_t* restrict age = readings->age + base;
+
+    // type:4 then twice sensor:8 age:10 temperature:12
+    for (size_t i = 0; i < 2 * n; ++i) {
+        uint64_t f = frames[i / 2];
+        uint32_t field = (f >> (i % 2 ? 0 : 30)) & 0x3FFFFFFF;
+        uint8_t sensor = field >> 22;
+
+        id[i] = sensor;
+        channel[i] = 0;
+        humidity[i] = 0;
+        age[i] = (field >> 12) & 0x3FF;
+        temperature[i] = (int16_t) (field << 4) >> 4;
+        rom[i] = 0;
+
+        flags[i] = ((f >> 60) == SAMPLES_FRAME_TYPE && sensor != SAMPLES_FRAME_EMPTY) * GATEWAY_VALID;
+    }
+
+    readings->count += 2 * n;
+
+    return n;
+}
+
+size_t gateway_decode_health(const uint64_t* frames, size_t count, gateway_health* health)
+{
+    size_t room = health->capacity - health->count;
+    size_t n = count < room ? count : room;
+    size_t base = health->count;
+
+    uint8_t* restrict id = health->id + base;
+    uint8_t* restrict flags = health->flags + base;
+    uint8_t* restrict presenceFailures = health->presenceFailures + base;
+    uint8_t* restrict crcFailures = health->crcFailures + base;
+    uint8_t* restrict retries = health->retries + base;
+
+    // type:4 id:8 presence failures:8 CRC failures:8 retries:8 search aborts:1
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t f = frames[i];
+
+        id[i] = f >> 52;
+        presenceFailures[i] = f >> 44;
+        crcFailures[i] = f >> 36;
+        retries[i] = f >> 28;
+
+        flags[i] = ((f >> 60) == STATS_RADIO_TYPE) * GATEWAY_VALID |
+            ((f >> 27) & 0x1) * GATEWAY_SEARCH_ABORTS;
+    }
+
+    health->count += n;
+
+    return n;
+}
+
+/**
+ * Parse a number in the given base, at least one digit
+ * @returns the position after the number or NULL
+ */
+static const char* parse_number(const char* p, const char* end, unsigned base, uint64_t* value)
+{
+    const char* start = p;
+
+    *value = 0;
+
+    for (; p < end; ++p) {
+        unsigned digit;
+
+        if (*p >= '0' && *p <= '9') {
+            digit = *p - '0';
+        } else if (base == 16 && *p >= 'a' && *p <= 'f') {
+            digit = *p - 'a' + 10;
+        } else if (base == 16 && *p >= 'A' && *p <= 'F') {
+            digit = *p - 'A' + 10;
+        } else {
+            break;
+        }
+
+        *value = *value * base + digit;
+    }
+
+    return p == start ? NULL : p;
+}
+
+static const char* parse_char(const char* p, const char* end, char c)
+{
+    return (p != NULL && p < end && *p == c) ? p + 1 : NULL;
+}
+
+/**
+ * Parse one measurement line (without the line end)
+ */
+static bool parse_line(const char* p, const char* end, gateway_readings* readings)
+{
+    uint64_t index, hash, id, channel, rom, value, raw;
+    bool negative;
+
+    if (!(p = parse_number(p, end, 10, &index)) || !(p = parse_char(p, end, ' ')) ||
+        !(p = parse_number(p, end, 16, &hash)) || !(p = parse_char(p, end, ' ')) ||
+        !(p = parse_number(p, end, 16, &id)) || !(p = parse_char(p, end, ' ')) ||
+        !(p = parse_number(p, end, 16, &channel)) || !(p = parse_char(p, end, ' '))) {
+        return false;
+    }
+
+    const char* romStart = p;
+
+    if (!(p = parse_number(p, end, 16, &rom)) || p - romStart != 16 ||
+        !(p = parse_char(p, end, ':')) || !(p = parse_char(p, end, ' '))) {
+        return false;
+    }
+
+    negative = p < end && *p == '-';
+    p += negative;
+
+    // Error lines carry a message instead of the temperature
+    if (!(p = parse_number(p, end, 10, &value)) || !(p = parse_char(p, end, ' ')) ||
+        !(p = parse_number(p, end, 16, &raw))) {
+        return false;
+    }
+
+    size_t i = readings->count++;
+
+    readings->id[i] = id;
+    readings->channel[i] = channel;
+    readings->flags[i] = GATEWAY_VALID;
+    readings->humidity[i] = 0;
+    readings->temperature[i] = negative ? -(int16_t) value : (int16_t) value;
+    readings->rom[i] = rom;
+    readings->age[i] = 0;
+
+    return true;
+}
+
+size_t gateway_parse_lines(const char* text, size_t length, gateway_readings* readings)
+{
+    const char* end = text + length;
+    size_t added = 0;
+
+    while (text < end && readings->count < readings->capacity) {
+        const char* lineEnd = memchr(text, '\n', end - text);
+
+        if (lineEnd == NULL) {
+            lineEnd = end;
+        }
+
+        // Lines end with "\r\n"
+        const char* contentEnd = (lineEnd > text && lineEnd[-1] == '\r') ? lineEnd - 1 : lineEnd;
+
+        added += parse_line(text, contentEnd, readings);
+        text = lineEnd + 1;
+    }
+
+    return added;
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+// Batch decoding of the node transmissions on a gateway
+//
+// Radio frames are packed into one 64-bit word each, first bit in bit 63, so
+// a batch is a plain array and the field extraction is the same shifts and
+// masks for every frame, without branches, which the compiler vectorizes.
+// Readings are stored as a structure of arrays for the same reason.
+//
+// Frames come from raw bytes (gateway_pack()), from pulse captures
+// (gateway_capture_frame()) or readings from the serial lines printed by
+// main.c (gateway_parse_lines()). Besides the Prologue and Nexus frames the
+// nodes send batch frames of two samples (samples.h, SAMPLES_FRAMES builds)
+// and bus health frames (stats.h, STATS_RADIO builds).
+
+#include "ook.h"
+
+// C
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// gateway_readings.flags
+#define GATEWAY_VALID 0x01
+#define GATEWAY_BATTERY_OK 0x02
+#define GATEWAY_BUTTON 0x04
+
+// gateway_health.flags
+#define GATEWAY_SEARCH_ABORTS 0x08
+
+typedef enum gateway_protocol {
+    kGatewayPrologue,
+    kGatewayNexus,
+    kGatewayBatch,
+    kGatewayHealth,
+} gateway_protocol;
+
+/**
+ * Decoded readings, structure of arrays with room for capacity entries
+ */
+typedef struct gateway_readings {
+    size_t count;
+    size_t capacity;
+
+    uint8_t* id;
+    uint8_t* channel;
+    uint8_t* flags;
+    uint8_t* humidity;
+
+    // Celsius x 10
+    int16_t* temperature;
+
+    // Sensor ROM, MSB is the family code (serial lines only, 0 for radio frames)
+    uint64_t* rom;
+
+    // Seconds from the measurement to the frame (batch frames only, 0 otherwise)
+    uint16_t* age;
+} gateway_readings;
+
+/**
+ * Decoded health frames, structure of arrays with room for capacity entries
+ */
+typedef struct gateway_health {
+    size_t count;
+    size_t capacity;
+
+    uint8_t* id;
+    uint8_t* flags;
+
+    // Counts of the node, saturated at 255
+    uint8_t* presenceFailures;
+    uint8_t* crcFailures;
+    uint8_t* retries;
+} gateway_health;
+
+/**
+ * Allocate the arrays of a reading batch
+ * @returns false if out of memory
+ */
+bool gateway_readings_alloc(gateway_readings* readings, size_t capacity);
+void gateway_readings_free(gateway_readings* readings);
+
+bool gateway_health_alloc(gateway_health* health, size_t capacity);
+void gateway_health_free(gateway_health* health);
+
+/**
+ * Point slice at the entries of readings starting at first, for decoding
+ * parts of a batch in parallel. The slice starts empty and must not be freed.
+ */
+void gateway_readings_slice(const gateway_readings* readings, size_t first, size_t length, gateway_readings* slice);
+
+/**
+ * Pack length bits (MSB of bytes[0] first) into a frame word
+ */
+uint64_t gateway_pack(const uint8_t* bytes, uint8_t length);
+
+/**
+ * Demodulate a pulse capture and pack the repeated frame it contains
+ * @returns false if no valid frame was found
+ */
+bool gateway_capture_frame(const ook_pulses* pulses, gateway_protocol protocol, uint64_t* frame);
+
+/**
+ * Decode count frames and append them to readings
+ * Frames that fail the protocol checks are added without GATEWAY_VALID.
+ * @returns the number of frames decoded, less than count if readings is full
+ */
+size_t gateway_decode_prologue(const uint64_t* frames, size_t count, gateway_readings* readings);
+size_t gateway_decode_nexus(const uint64_t* frames, size_t count, gateway_readings* readings);
+
+/**
+ * Decode count batch frames and append two readings for each: the id is the
+ * sensor handle of the node, the channel 0. The empty second field of a
+ * frame with an odd sample is added without GATEWAY_VALID.
+ * @returns the number of frames decoded, less than count if readings has no
+ * room for both readings of a frame
+ */
+size_t gateway_decode_batch(const uint64_t* frames, size_t count, gateway_readings* readings);
+
+/**
+ * Decode count health frames and append them to health
+ * @returns the number of frames decoded, less than count if health is full
+ */
+size_t gateway_decode_health(const uint64_t* frames, size_t count, gateway_health* health);
+
+/**
+ * Parse the measurement lines main.c prints on the serial port
+ *
+ *   <index> <hash> <id> <channel> <rom>: <celsius x 10> <raw>[ <bus time>us]
+ *
+ * and append them to readings. Other lines (errors, "Hello!") are skipped.
+ *
+ * @returns the number of readings added
+ */
+size_t gateway_parse_lines(const char* text, size_t length, gateway_readings* readings);
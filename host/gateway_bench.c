@@ -0,0 +1,359 @@
+// Check and throughput benchmark of the gateway batch decoder in gateway.c
+//
+// Frames sent by radio.c are captured in the simulation and decoded back,
+// serial lines in the format of main.c are parsed, then large batches are
+// decoded on one thread and split across all cores.
+
+#include "gateway.h"
+#include "ook.h"
+#include "sim.h"
+
+#include "radio.h"
+#include "samples.h"
+#include "stats.h"
+
+// C
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_FRAMES (1 << 20)
+#define BENCH_ROUNDS 20
+#define BENCH_LINES (1 << 16)
+#define MAX_THREADS 16
+
+static ook_pulses pulses;
+
+static double seconds_since(const struct timespec* start)
+{
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static int check_reading(const char* name, const gateway_readings* r, size_t i,
+    uint8_t id, uint8_t channel, int16_t temperature, uint8_t humidity, uint8_t flags)
+{
+    if (r->id[i] != id || r->channel[i] != channel || r->temperature[i] != temperature ||
+        r->humidity[i] != humidity || r->flags[i] != flags) {
+        printf("FAIL %s: got id=%02x ch=%u t=%d h=%u flags=%x\n", name,
+            r->id[i], r->channel[i], r->temperature[i], r->humidity[i], r->flags[i]);
+        return 1;
+    }
+
+    return 0;
+}
+
+static int check_radio(gateway_readings* readings)
+{
+    uint64_t frame;
+    int failures = 0;
+
+    sim_reset();
+    ook_capture_start(&pulses);
+    prologue_send(0x5A, 3, -405, 55, 1, 1);
+    ook_capture_stop();
+
+    if (!gateway_capture_frame(&pulses, kGatewayPrologue, &frame)) {
+        printf("FAIL prologue capture not decoded\n");
+        return 1;
+    }
+
+    gateway_decode_prologue(&frame, 1, readings);
+    failures += check_reading("prologue", readings, readings->count - 1, 0x5A, 3, -405, 55,
+        GATEWAY_VALID | GATEWAY_BATTERY_OK | GATEWAY_BUTTON);
+
+    sim_reset();
+    ook_capture_start(&pulses);
+    nexus_send(0xC3, 2, 1250, 42, 0);
+    ook_capture_stop();
+
+    if (!gateway_capture_frame(&pulses, kGatewayNexus, &frame)) {
+        printf("FAIL nexus capture not decoded\n");
+        return 1;
+    }
+
+    // Every repeat, the last one too, ends with a closed gap
+    ook_bits bits;
+    uint8_t complete = 0;
+
+    ook_demod_ppm(&pulses, &ook_timing_nexus, &bits);
+
+    for (uint8_t row = 0; row < bits.rows; ++row) {
+        complete += bits.bits[row] == 36;
+    }
+
+    if (complete != pgm_read_byte(&radio_protocol_nexus.repeats)) {
+        printf("FAIL nexus: %u of %u rows complete\n", complete, bits.rows);
+        failures++;
+    }
+
+    gateway_decode_nexus(&frame, 1, readings);
+    failures += check_reading("nexus", readings, readings->count - 1, 0xC3, 2, 1250, 42, GATEWAY_VALID);
+
+    // A Nexus frame is not a valid Prologue frame
+    gateway_decode_prologue(&frame, 1, readings);
+
+    if (readings->flags[readings->count - 1] & GATEWAY_VALID) {
+        printf("FAIL nexus frame accepted as prologue\n");
+        failures++;
+    }
+
+    return failures;
+}
+
+/**
+ * The frames of the node's own formats: batch frames and health frames
+ */
+static int check_node_frames(gateway_readings* readings)
+{
+    static const sample_t batch[] = { { 100, 3, 21 * 16 + 8 }, { 160, 17, -10 * 16 - 2 } };
+    gateway_health health;
+    uint64_t frame;
+    int failures = 0;
+
+    sim_reset();
+    samples_init();
+
+    for (uint8_t i = 0; i < 2; ++i) {
+        samples_push(&batch[i]);
+    }
+
+    ook_capture_start(&pulses);
+    samples_send(200);
+    ook_capture_stop();
+
+    if (!gateway_capture_frame(&pulses, kGatewayBatch, &frame)) {
+        printf("FAIL batch capture not decoded\n");
+        return 1;
+    }
+
+    size_t first = readings->count;
+
+    if (gateway_decode_batch(&frame, 1, readings) != 1) {
+        printf("FAIL batch frame not decoded\n");
+        return 1;
+    }
+
+    failures += check_reading("batch 0", readings, first, 3, 0, 215, 0, GATEWAY_VALID);
+    failures += check_reading("batch 1", readings, first + 1, 17, 0, -101, 0, GATEWAY_VALID);
+
+    if (readings->age[first] != 100 || readings->age[first + 1] != 40) {
+        printf("FAIL batch ages %u %u\n", readings->age[first], readings->age[first + 1]);
+        failures++;
+    }
+
+    // Neither is a Prologue frame
+    gateway_decode_prologue(&frame, 1, readings);
+
+    if (readings->flags[readings->count - 1] & GATEWAY_VALID) {
+        printf("FAIL batch frame accepted as prologue\n");
+        failures++;
+    }
+
+    stats_clear();
+    stats_bus.presenceFailures = 7;
+    stats_bus.romCrcFailures = 200;
+    stats_bus.scratchPadCrcFailures = 100;
+    stats_bus.retries = 12;
+    stats_bus.searchAborts = 1;
+
+    sim_reset();
+    ook_capture_start(&pulses);
+    stats_send();
+    ook_capture_stop();
+
+    if (!gateway_health_alloc(&health, 1)) {
+        printf("out of memory\n");
+        return failures + 1;
+    }
+
+    if (!gateway_capture_frame(&pulses, kGatewayHealth, &frame) ||
+        gateway_decode_health(&frame, 1, &health) != 1) {
+        printf("FAIL health frame not decoded\n");
+        failures++;
+    } else if (health.id[0] != STATS_RADIO_ID || health.presenceFailures[0] != 7 ||
+        health.crcFailures[0] != 255 || health.retries[0] != 12 ||
+        health.flags[0] != (GATEWAY_VALID | GATEWAY_SEARCH_ABORTS)) {
+        printf("FAIL health: id=%02x presence=%u crc=%u retries=%u flags=%x\n", health.id[0],
+            health.presenceFailures[0], health.crcFailures[0], health.retries[0], health.flags[0]);
+        failures++;
+    }
+
+    gateway_decode_prologue(&frame, 1, readings);
+
+    if (readings->flags[readings->count - 1] & GATEWAY_VALID) {
+        printf("FAIL health frame accepted as prologue\n");
+        failures++;
+    }
+
+    gateway_health_free(&health);
+
+    return failures;
+}
+
+static const char lines[] =
+    "Hello!\r\n"
+    "0 1c2b 02 03 286164123c7a05d0: 215 0158\r\n"
+    "1 a017 01 03 28ff023456789a88: -101 ffffff5e 5312us\r\n"
+    "2 93e1 0e 01 103e8b41020800e8: read_slave: crc error\r\n"
+    "\r\n";
+
+static int check_lines(gateway_readings* readings)
+{
+    size_t first = readings->count;
+    int failures = 0;
+
+    if (gateway_parse_lines(lines, strlen(lines), readings) != 2) {
+        printf("FAIL serial lines: %u readings\n", (unsigned) (readings->count - first));
+        return 1;
+    }
+
+    failures += check_reading("line 0", readings, first, 0x02, 3, 215, 0, GATEWAY_VALID);
+    failures += check_reading("line 1", readings, first + 1, 0x01, 3, -101, 0, GATEWAY_VALID);
+
+    if (readings->rom[first + 1] != 0x28ff023456789a88ULL) {
+        printf("FAIL line 1 rom\n");
+        failures++;
+    }
+
+    return failures;
+}
+
+typedef size_t (*bench_decoder)(const uint64_t* frames, size_t count, gateway_readings* readings);
+
+typedef struct bench_job {
+    bench_decoder decode;
+    const uint64_t* frames;
+    size_t count;
+    gateway_readings readings;
+} bench_job;
+
+static void* bench_thread(void* arg)
+{
+    bench_job* job = arg;
+
+    for (int round = 0; round < BENCH_ROUNDS; ++round) {
+        job->readings.count = 0;
+        job->decode(job->frames, job->count, &job->readings);
+    }
+
+    return NULL;
+}
+
+/**
+ * Decode BENCH_FRAMES frames of which each gives perFrame readings
+ */
+static void bench_frames(const char* name, bench_decoder decode, unsigned perFrame,
+    const uint64_t* frames, gateway_readings* readings, unsigned threads)
+{
+    pthread_t thread[MAX_THREADS];
+    bench_job jobs[MAX_THREADS];
+    struct timespec start;
+    size_t slice = BENCH_FRAMES / threads;
+
+    for (unsigned t = 0; t < threads; ++t) {
+        jobs[t].decode = decode;
+        jobs[t].frames = frames + t * slice;
+        jobs[t].count = t == threads - 1 ? BENCH_FRAMES - t * slice : slice;
+        gateway_readings_slice(readings, t * slice * perFrame, jobs[t].count * perFrame, &jobs[t].readings);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (unsigned t = 0; t < threads; ++t) {
+        pthread_create(&thread[t], NULL, bench_thread, &jobs[t]);
+    }
+
+    for (unsigned t = 0; t < threads; ++t) {
+        pthread_join(thread[t], NULL);
+    }
+
+    double seconds = seconds_since(&start);
+
+    printf("%-8s %2u thread%s %14.0f frames/s\n", name, threads, threads > 1 ? "s" : " ",
+        (double) BENCH_FRAMES * BENCH_ROUNDS / seconds);
+}
+
+static void bench_lines(gateway_readings* readings)
+{
+    static const char line[] = "12 1c2b 02 03 286164123c7a05d0: -215 ff28 5312us\r\n";
+    size_t length = sizeof(line) - 1;
+    char* text = malloc(length * BENCH_LINES);
+    struct timespec start;
+
+    for (size_t i = 0; i < BENCH_LINES; ++i) {
+        memcpy(text + i * length, line, length);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int round = 0; round < BENCH_ROUNDS; ++round) {
+        readings->count = 0;
+        gateway_parse_lines(text, length * BENCH_LINES, readings);
+    }
+
+    double seconds = seconds_since(&start);
+
+    printf("%-8s  1 thread  %14.0f lines/s\n", "lines", (double) BENCH_LINES * BENCH_ROUNDS / seconds);
+
+    free(text);
+}
+
+int main(void)
+{
+    gateway_readings readings;
+    uint64_t* frames = malloc(BENCH_FRAMES * sizeof(uint64_t));
+    int failures = 0;
+
+    // Batch frames give two readings each
+    if (frames == NULL || !gateway_readings_alloc(&readings, 2 * BENCH_FRAMES)) {
+        printf("out of memory\n");
+        return 1;
+    }
+
+    failures += check_radio(&readings);
+    failures += check_node_frames(&readings);
+    failures += check_lines(&readings);
+
+    printf("gateway decode: %s\n\n", failures ? "FAIL" : "ok");
+
+    // Same frame layout as prologue_send(), with varying id, temperature and humidity
+    for (size_t i = 0; i < BENCH_FRAMES; ++i) {
+        uint8_t bytes[5] = { 0x90 | (i & 0x0F), (i & 0xF0) | 0x09, i >> 4, (i << 4) | 0x3, 0x70 };
+
+        frames[i] = gateway_pack(bytes, 37);
+    }
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned threads = cores < 1 ? 1 : cores > MAX_THREADS ? MAX_THREADS : cores;
+
+    bench_frames("prologue", gateway_decode_prologue, 1, frames, &readings, 1);
+
+    if (threads > 1) {
+        bench_frames("prologue", gateway_decode_prologue, 1, frames, &readings, threads);
+    }
+
+    // The same bits as batch frames, two samples each
+    for (size_t i = 0; i < BENCH_FRAMES; ++i) {
+        frames[i] = (frames[i] & ~(0xFULL << 60)) | ((uint64_t) SAMPLES_FRAME_TYPE << 60);
+    }
+
+    bench_frames("batch", gateway_decode_batch, 2, frames, &readings, 1);
+
+    if (threads > 1) {
+        bench_frames("batch", gateway_decode_batch, 2, frames, &readings, threads);
+    }
+
+    bench_lines(&readings);
+
+    gateway_readings_free(&readings);
+    free(frames);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,610 @@
+// Host simulation of the acquisition loop in main.c
+//
+// Runs the search, conversion, scratch pad read and radio transmission of
+// every sensor on a simulated bus, and writes the 1-Wire and radio pins as a
+// VCD file annotated with the decoded bus traffic:
+//
+//   ./host/bin/onewire_sim host/bin/onewire.vcd && gtkwave host/bin/onewire.vcd
+
+#include "ow_bus.h"
+#include "sim.h"
+#include "vcd.h"
+
+#include "crc.h"
+#include "defines.h"
+#include "ds18b20.h"
+#include "onewire.h"
+#include "radio.h"
+#include "stats.h"
+#include "trace.h"
+
+// AVR replacements
+#include <avr/io.h>
+#include <util/delay.h>
+
+// C
+#include <stdio.h>
+
+typedef struct sensor_case {
+    uint8_t family;
+    uint8_t serial[6];
+    int16_t temperature;
+} sensor_case;
+
+// The README setup, two DS18B20 and one DS1820, plus a DS1820 below zero
+static const sensor_case sensors[] = {
+    { 0x28, { 0x61, 0x64, 0x12, 0x3C, 0x7A, 0x05 }, 21 * 16 + 8 },
+    { 0x28, { 0xFF, 0x02, 0x34, 0x56, 0x78, 0x9A }, -10 * 16 - 2 },
+    { 0x10, { 0x3E, 0x8B, 0x41, 0x02, 0x08, 0x00 }, 23 * 16 + 4 },
+    { 0x10, { 0x94, 0x77, 0x15, 0x02, 0x08, 0x00 }, -5 * 16 - 13 },
+};
+
+#define SENSOR_COUNT (sizeof(sensors) / sizeof(sensors[0]))
+
+#ifdef TRACE
+
+/**
+ * The timing trace of the acquisition loop against the nominal periods. The
+ * simulation does not count the pin accesses the delays leave room for, so
+ * the periods come out that much short.
+ */
+static int check_trace(void)
+{
+    static const char* names[kTrace_ChannelCount] = {
+        "ow reset", "ow write0", "ow write1", "ow read", "rf pulse", "rf gap0", "rf gap1", "rf sync",
+    };
+    int failures = 0;
+
+    for (uint8_t i = 0; i < kTrace_ChannelCount; ++i) {
+        int32_t error = (int32_t) trace_mean_us(i) - trace_target_us(i);
+
+        printf("trace %-9s %5u us, target %5u us\n", names[i], trace_mean_us(i), trace_target_us(i));
+
+        if (trace_mean_us(i) == 0 || error < -12 || error > 2) {
+            printf("FAIL trace %s\n", names[i]);
+            failures++;
+        }
+    }
+
+    return failures;
+}
+
+#endif
+
+/**
+ * The fast scratch pad read modes must give the same value as the full read
+ */
+static int check_read_modes(const gpin_t* pin)
+{
+    static const char* names[] = { "full", "fast plausible" };
+    onewire_search_state search;
+    int failures = 0;
+    uint32_t slots[2] = { 0, 0 };
+
+    onewire_search_init(&search);
+
+    // The second DS18B20 runs at 10 bits: its undefined low bits are set
+    ow_device* device = ow_bus_device(1);
+    ow_device saved = *device;
+
+    device->scratchpad[4] = 0x3F;
+    device->scratchpad[8] = crc8(device->scratchpad, 8);
+
+    while (onewire_search(pin, &search)) {
+        uint16_t full = 0;
+        uint8_t resolution = 3;
+
+        for (uint8_t mode = kDS18B20_ReadFull; mode <= kDS18B20_ReadFastPlausible; ++mode) {
+            uint32_t start = ow_bus_slots();
+            uint16_t reading = ds18b20_read_slave_mode(pin, search.address, mode, &resolution);
+
+            slots[mode] += ow_bus_slots() - start;
+
+            if (mode == kDS18B20_ReadFull) {
+                full = reading;
+            } else if (reading != full) {
+                printf("FAIL %s read of %02x..%02x: %04x, full read %04x\n", names[mode],
+                    search.address[0], search.address[7], reading, full);
+                failures++;
+            }
+        }
+    }
+
+    for (uint8_t mode = kDS18B20_ReadFull; mode <= kDS18B20_ReadFastPlausible; ++mode) {
+        printf("read %-14s %4u slots for %u devices\n", names[mode], slots[mode], ow_bus_device_count());
+    }
+
+    if (slots[kDS18B20_ReadFastPlausible] >= slots[kDS18B20_ReadFull]) {
+        printf("FAIL fast read is not faster\n");
+        failures++;
+    }
+
+    // Without the resolution the fast modes see the undefined bits
+    if (ds18b20_read_slave_mode(pin, device->rom, kDS18B20_ReadFastPlausible, NULL) ==
+        ds18b20_read_slave(pin, device->rom)) {
+        printf("FAIL 10-bit device decoded at 12 bits\n");
+        failures++;
+    }
+
+    *device = saved;
+
+    // An empty scratch pad (all ones) must be rejected
+    device = ow_bus_device(0);
+    saved = *device;
+
+    device->scratchpad[0] = 0xFF;
+    device->scratchpad[1] = 0xFF;
+
+    if (ds18b20_read_slave_mode(pin, device->rom, kDS18B20_ReadFastPlausible, NULL) != kDS18B20_ValidationFailed) {
+        printf("FAIL all ones scratch pad accepted\n");
+        failures++;
+    }
+
+    // Neither is the power-on value
+    device->scratchpad[0] = 0x50;
+    device->scratchpad[1] = 0x05;
+
+    if (ds18b20_read_slave_mode(pin, device->rom, kDS18B20_ReadFastPlausible, NULL) != kDS18B20_ValidationFailed) {
+        printf("FAIL power-on scratch pad accepted\n");
+        failures++;
+    }
+
+    // A value out of range must not pass for a special return value
+    device->scratchpad[0] = 0x00;
+    device->scratchpad[1] = 0x50;
+
+    if (ds18b20_read_slave_mode(pin, device->rom, kDS18B20_ReadFastPlausible, NULL) != kDS18B20_ValidationFailed) {
+        printf("FAIL out of range scratch pad accepted\n");
+        failures++;
+    }
+
+    *device = saved;
+
+    // DS1820 at +125C is plausible, 0x00AA only when it is not the power-on value
+    device = ow_bus_device(2);
+    saved = *device;
+
+    device->scratchpad[0] = 0xFA;
+    device->scratchpad[1] = 0x00;
+    device->scratchpad[6] = 0x0C;
+
+    if (ds18b20_read_slave_mode(pin, device->rom, kDS18B20_ReadFastPlausible, NULL) != 125 * 16) {
+        printf("FAIL DS1820 +125C rejected\n");
+        failures++;
+    }
+
+    device->scratchpad[0] = 0xAA;
+
+    if (ds18b20_read_slave_mode(pin, device->rom, kDS18B20_ReadFastPlausible, NULL) != kDS18B20_ValidationFailed) {
+        printf("FAIL DS1820 power-on scratch pad accepted\n");
+        failures++;
+    }
+
+    device->scratchpad[6] = 0x0B;
+
+    if (ds18b20_read_slave_mode(pin, device->rom, kDS18B20_ReadFastPlausible, NULL) != 85 * 16 + 1) {
+        printf("FAIL DS1820 85C reading rejected\n");
+        failures++;
+    }
+
+    *device = saved;
+
+    return failures;
+}
+
+/**
+ * The health counters must agree with the traffic the bus model saw
+ */
+static int check_stats(const gpin_t* pin)
+{
+    int failures = 0;
+
+    if (stats_bus.resets != ow_bus_resets() || stats_bus.slots != ow_bus_slots()) {
+        printf("FAIL stats: %u resets, %u slots counted\n", stats_bus.resets, stats_bus.slots);
+        failures++;
+    }
+
+    if (stats_bus.presenceFailures || stats_bus.searchAborts || stats_bus.romCrcFailures ||
+        stats_bus.scratchPadCrcFailures) {
+        printf("FAIL stats: failures counted on a healthy bus\n");
+        failures++;
+    }
+
+    // A corrupted scratch pad is counted once per read
+    ow_device* device = ow_bus_device(0);
+    ow_device saved = *device;
+
+    device->scratchpad[8] ^= 0x01;
+    ds18b20_read_slave(pin, device->rom);
+    *device = saved;
+
+    if (stats_bus.scratchPadCrcFailures != 1) {
+        printf("FAIL stats: %u scratch pad crc failures\n", stats_bus.scratchPadCrcFailures);
+        failures++;
+    }
+
+    printf("stats: estimated bus time %u ms\n", stats_bus_time());
+
+    // Long uptimes must not wrap the bus time estimate
+    stats_bus_t counted = stats_bus;
+
+    stats_bus.resets = 5000000;
+    stats_bus.slots = 0;
+
+    if (stats_bus_time() != 5000000UL / 1000 * STATS_RESET_US) {
+        printf("FAIL stats: %u ms for 5000000 resets\n", stats_bus_time());
+        failures++;
+    }
+
+    stats_bus = counted;
+
+    return failures;
+}
+
+/**
+ * Search and read every sensor rounds times
+ * @returns the number of wrong or missing readings
+ */
+static int read_all(const gpin_t* pin, int rounds, double* slotRate)
+{
+    onewire_search_state search;
+    int failures = 0;
+    uint32_t slots = ow_bus_slots();
+    uint64_t start = sim_now();
+
+    for (int round = 0; round < rounds; ++round) {
+        unsigned reads = 0;
+
+        onewire_search_init(&search);
+
+        while (onewire_search(pin, &search)) {
+            for (unsigned i = 0; i < SENSOR_COUNT; ++i) {
+                if (sensors[i].serial[0] == search.address[1] &&
+                    (int16_t) ds18b20_read_slave(pin, search.address) != sensors[i].temperature) {
+                    failures++;
+                }
+            }
+
+            reads++;
+        }
+
+        failures += SENSOR_COUNT - reads;
+    }
+
+    *slotRate = (ow_bus_slots() - slots) / ((sim_now() - start) / 1e9);
+
+    return failures;
+}
+
+/**
+ * Interrupts firing at random during bus traffic must not corrupt any bit
+ *
+ * The handlers run for up to 25uS, on average every 300uS. Two of them can
+ * come back to back, which still fits the 58uS budget a write 0 leaves
+ * between its 62uS low part and the 120uS limit (see onewire.c). The slot
+ * rate only drops by the CPU time the handlers take, there are no retries,
+ * and no slot may stay low past 120uS.
+ */
+static int check_interrupts(const gpin_t* pin)
+{
+    static const int kRounds = 25;
+    uint32_t crcFailures = stats_bus.scratchPadCrcFailures;
+    uint32_t longSlots = ow_bus_long_slots();
+    double quiet, busy;
+
+    int failures = read_all(pin, kRounds, &quiet);
+
+    sim_irq_inject(300 * 1000, 25 * 1000, 0x1234567);
+    failures += read_all(pin, kRounds, &busy);
+
+    printf("interrupts: %u handlers, %d bad reads, %u crc failures, %u long slots, %.0f slots/s "
+        "(%.0f without), longest masked %.1f us\n", sim_irq_count(), failures,
+        stats_bus.scratchPadCrcFailures - crcFailures, ow_bus_long_slots() - longSlots, busy, quiet,
+        sim_irq_max_masked() / 1000.0);
+
+    sim_irq_inject(0, 0, 0);
+
+    if (failures || stats_bus.scratchPadCrcFailures != crcFailures) {
+        printf("FAIL interrupts corrupted the bus traffic\n");
+        failures++;
+    }
+
+    if (ow_bus_long_slots() != longSlots) {
+        printf("FAIL interrupts stretched a write 0 past 120 us\n");
+        failures++;
+    }
+
+    return failures;
+}
+
+/**
+ * Expected reading of the sensor with the given address
+ */
+static int16_t expected_reading(const uint8_t* address)
+{
+    for (unsigned i = 0; i < SENSOR_COUNT; ++i) {
+        if (sensors[i].serial[0] == address[1]) {
+            return sensors[i].temperature;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Convert and read all sensors the way main.c does
+ * @returns the number of wrong readings
+ */
+static int convert_and_read(const gpin_t* pin, uint8_t strategy)
+{
+    onewire_search_state search;
+    int failures = 0;
+
+    if (strategy != kDS18B20_ConvertSequential) {
+        ds18b20_convert_wait(pin, NULL, strategy);
+    }
+
+    onewire_search_init(&search);
+
+    while (onewire_search(pin, &search)) {
+        if (strategy == kDS18B20_ConvertSequential) {
+            ds18b20_convert_wait(pin, search.address, strategy);
+        }
+
+        failures += (int16_t) ds18b20_read_slave(pin, search.address) != expected_reading(search.address);
+    }
+
+    return failures;
+}
+
+static unsigned brownouts(void)
+{
+    unsigned count = 0;
+
+    for (uint8_t i = 0; i < ow_bus_device_count(); ++i) {
+        count += ow_bus_device(i)->brownouts;
+    }
+
+    return count;
+}
+
+/**
+ * Switching the radio or the LED off must leave the other port pins alone
+ */
+static int check_port_bits(void)
+{
+    int failures = 0;
+    uint8_t bits = 0xFF;
+
+    BIT_CLEAR(bits, PIN_LED);
+
+    if (bits != (uint8_t) ~(1 << PIN_LED)) {
+        printf("FAIL port: clearing pin %u left %02x\n", PIN_LED, bits);
+        failures++;
+    }
+
+    LED_ON;
+    RADIO_ON;
+    RADIO_OFF;
+
+    if (!(PORT & (1 << PIN_LED)) || (PORT & (1 << PIN_RADIO))) {
+        printf("FAIL port: %02x after switching the radio off\n", PORT);
+        failures++;
+    }
+
+    LED_OFF;
+
+    if (PORT & (1 << PIN_LED)) {
+        printf("FAIL port: %02x after switching the LED off\n", PORT);
+        failures++;
+    }
+
+    return failures;
+}
+
+static void set_parasite(bool parasite)
+{
+    // One DS18B20 and one DS1820
+    ow_bus_device(0)->parasite = parasite;
+    ow_bus_device(2)->parasite = parasite;
+}
+
+/**
+ * Power supply detection and the conversion strategies
+ */
+static int check_parasite(const gpin_t* pin)
+{
+    static const gpin_t mosfetPin = { &PORTB, &PINB, &DDRB, PB1 };
+    static const struct {
+        const char* name;
+        bool parasite;
+        uint8_t pullup;
+        uint8_t strategy;
+    } cases[] = {
+        { "external", false, kDS18B20_PullupBusPin, kDS18B20_ConvertParallel },
+        { "parasite, bus pin", true, kDS18B20_PullupBusPin, kDS18B20_ConvertParallelPullup },
+        { "parasite, mosfet", true, kDS18B20_PullupMosfet, kDS18B20_ConvertParallelPullup },
+        { "parasite, resistor", true, kDS18B20_PullupNone, kDS18B20_ConvertSequential },
+    };
+
+    int failures = 0;
+
+    for (unsigned c = 0; c < sizeof(cases) / sizeof(cases[0]); ++c) {
+        set_parasite(cases[c].parasite);
+        ds18b20_set_pullup(cases[c].pullup, &mosfetPin);
+        ow_bus_set_pullup(cases[c].pullup == kDS18B20_PullupMosfet ? &mosfetPin : NULL);
+
+        unsigned before = brownouts();
+        uint64_t start = sim_now();
+        uint8_t strategy = ds18b20_strategy(pin);
+        int bad = convert_and_read(pin, strategy);
+
+        printf("power %-18s strategy %u, %.3f s per cycle, %d bad readings, %u brownouts\n",
+            cases[c].name, strategy, (sim_now() - start) / 1e9, bad, brownouts() - before);
+
+        if (strategy != cases[c].strategy || bad || brownouts() != before) {
+            printf("FAIL power %s\n", cases[c].name);
+            failures++;
+        }
+    }
+
+    // Converting the parasite devices together on the resistor alone must fail
+    unsigned before = brownouts();
+
+    ds18b20_set_pullup(kDS18B20_PullupNone, NULL);
+    ow_bus_set_pullup(NULL);
+
+    if (convert_and_read(pin, kDS18B20_ConvertParallelPullup) == 0 || brownouts() == before) {
+        printf("FAIL power: parallel parasite conversion without pull-up did not brown out\n");
+        failures++;
+    }
+
+    set_parasite(false);
+    ds18b20_set_pullup(kDS18B20_PullupBusPin, NULL);
+
+    return failures;
+}
+
+/**
+ * Family filtered search and ROM verification
+ */
+static int check_targeted_search(const gpin_t* pin)
+{
+    static const struct {
+        uint8_t family;
+        unsigned count;
+    } families[] = { { 0x28, 2 }, { 0x10, 2 }, { 0x22, 0 } };
+
+    onewire_search_state search;
+    int failures = 0;
+
+    for (unsigned f = 0; f < sizeof(families) / sizeof(families[0]); ++f) {
+        uint32_t slots = ow_bus_slots();
+        unsigned found = 0;
+
+        onewire_search_family_init(&search, families[f].family);
+
+        while (onewire_search(pin, &search)) {
+            if (search.address[0] != families[f].family) {
+                printf("FAIL family %02x search returned %02x\n", families[f].family, search.address[0]);
+                failures++;
+            }
+
+            if (!onewire_verify_rom(pin, search.address)) {
+                printf("FAIL verify of a present device\n");
+                failures++;
+            }
+
+            // Change the serial number, the device must not be found
+            search.address[3] ^= 0x10;
+
+            if (onewire_verify_rom(pin, search.address)) {
+                printf("FAIL verify of a missing device\n");
+                failures++;
+            }
+
+            search.address[3] ^= 0x10;
+            found++;
+        }
+
+        printf("family %02x: %u devices, %u slots including verification\n",
+            families[f].family, found, ow_bus_slots() - slots);
+
+        if (found != families[f].count) {
+            printf("FAIL family %02x: found %u of %u\n", families[f].family, found, families[f].count);
+            failures++;
+        }
+    }
+
+    return failures;
+}
+
+int main(int argc, char** argv)
+{
+    const char* path = argc > 1 ? argv[1] : "host/bin/onewire.vcd";
+    const gpin_t sensorPin = { &PORTC, &PINC, &DDRC, PC2 };
+    onewire_search_state search;
+    int failures = 0;
+    unsigned found = 0;
+
+    sim_reset();
+    trace_init();
+
+    if (vcd_open(path) != 0) {
+        printf("can't open %s\n", path);
+        return 1;
+    }
+
+    vcd_watch_pin("radio", &PORT, PIN_RADIO);
+
+    ow_bus_init(&sensorPin);
+    ow_bus_trace();
+
+    for (unsigned i = 0; i < SENSOR_COUNT; ++i) {
+        ow_bus_add(sensors[i].family, sensors[i].serial, sensors[i].temperature);
+    }
+
+    onewire_search_init(&search);
+
+    while (onewire_search(&sensorPin, &search)) {
+        found++;
+
+        if (!onewire_check_rom_crc(&search)) {
+            printf("FAIL rom crc\n");
+            failures++;
+            continue;
+        }
+
+        ds18b20_convert_slave(&sensorPin, search.address);
+        _delay_ms(750);
+
+        int16_t reading = ds18b20_read_slave(&sensorPin, search.address);
+
+        // Expected value, in the format ds18b20_read_slave() returns
+        int16_t expected = 0;
+
+        for (unsigned i = 0; i < SENSOR_COUNT; ++i) {
+            if (sensors[i].serial[0] == search.address[1]) {
+                expected = sensors[i].temperature;
+            }
+        }
+
+        printf("%02x%02x%02x%02x%02x%02x%02x%02x: %04x (%.4f C), expected %.4f C\n",
+            search.address[0], search.address[1], search.address[2], search.address[3],
+            search.address[4], search.address[5], search.address[6], search.address[7],
+            (uint16_t) reading, reading / 16.0, expected / 16.0);
+
+        if (reading != expected) {
+            printf("FAIL reading\n");
+            failures++;
+        }
+
+        prologue_send(search.address[1] & 0x7F, 1, reading * 10 / 16, 11, 1, 0);
+    }
+
+    if (found != SENSOR_COUNT) {
+        printf("FAIL found %u of %u devices\n", found, (unsigned) SENSOR_COUNT);
+        failures++;
+    }
+
+    printf("%u resets, %u slots, %.3f s simulated\n",
+        ow_bus_resets(), ow_bus_slots(), sim_now() / 1e9);
+
+#ifdef TRACE
+    failures += check_trace();
+#endif
+
+    failures += check_stats(&sensorPin);
+    failures += check_port_bits();
+
+    failures += check_read_modes(&sensorPin);
+    failures += check_interrupts(&sensorPin);
+    failures += check_parasite(&sensorPin);
+    failures += check_targeted_search(&sensorPin);
+
+    vcd_close();
+
+    printf("wrote %s\n", path);
+
+    return failures ? 1 : 0;
+}
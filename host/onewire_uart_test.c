@@ -0,0 +1,199 @@
+// Check of the USART backend of the 1-Wire bus (onewire_uart.c)
+//
+// USART0 is connected to a simulated bus (sim_usart_connect()), so every
+// UART frame becomes a bus slot the devices answer. Sensors are searched
+// and read through it, an empty and a shorted bus must fail the reset, and
+// the software transmitter usart.c uses instead of USART0 must send frames
+// at the baud rate.
+
+#include "ow_bus.h"
+#include "sim.h"
+
+#include "ds18b20.h"
+#include "onewire.h"
+#include "stats.h"
+#include "usart.h"
+
+// AVR replacements
+#include <avr/io.h>
+#include <util/delay.h>
+
+// C
+#include <stdio.h>
+#include <string.h>
+
+// TXD and RXD both on the bus
+static const gpin_t busPin = { &PORTD, &PIND, &DDRD, PD1 };
+
+static int check_bus(void)
+{
+    static const uint8_t serial[3][6] = {
+        { 0x61, 0x64, 0x12, 0x3C, 0x7A, 0x05 },
+        { 0xFF, 0x02, 0x34, 0x56, 0x78, 0x9A },
+        { 0x3E, 0x8B, 0x41, 0x02, 0x08, 0x00 },
+    };
+    static const uint8_t family[3] = { 0x28, 0x28, 0x10 };
+    static const int16_t temperature[3] = { 21 * 16 + 8, -10 * 16 - 2, 23 * 16 + 4 };
+    onewire_search_state search;
+    unsigned found = 0;
+    int failures = 0;
+
+    sim_reset();
+    ow_bus_init(&busPin);
+    sim_usart_connect(&busPin);
+    stats_clear();
+
+    for (unsigned i = 0; i < 3; ++i) {
+        ow_bus_add(family[i], serial[i], temperature[i]);
+    }
+
+    ds18b20_convert(&busPin);
+    _delay_ms(750);
+
+    onewire_search_init(&search);
+
+    while (onewire_search(&busPin, &search)) {
+        for (uint8_t mode = kDS18B20_ReadFull; mode <= kDS18B20_ReadFastPlausible; ++mode) {
+            int16_t reading = ds18b20_read_slave_mode(&busPin, search.address, mode, NULL);
+
+            for (unsigned i = 0; i < 3; ++i) {
+                if (search.address[1] == serial[i][0] && reading != temperature[i]) {
+                    printf("FAIL uart reading of %02x..%02x in mode %u: %04x\n",
+                        search.address[0], search.address[7], mode, (uint16_t) reading);
+                    failures++;
+                }
+            }
+        }
+
+        found++;
+    }
+
+    printf("uart: %u devices found, %u resets, %u slots in %.1f ms\n",
+        found, ow_bus_resets(), ow_bus_slots(), sim_now() / 1e6 - 750);
+
+    if (found != 3) {
+        printf("FAIL uart search found %u devices\n", found);
+        failures++;
+    }
+
+    if (stats_bus.resets != ow_bus_resets() || stats_bus.slots != ow_bus_slots() ||
+        stats_bus.presenceFailures != 0 || ow_bus_long_slots() != 0) {
+        printf("FAIL uart stats: %u resets, %u slots, %u without presence\n",
+            stats_bus.resets, stats_bus.slots, stats_bus.presenceFailures);
+        failures++;
+    }
+
+    return failures;
+}
+
+static int check_reset_failures(void)
+{
+    int failures = 0;
+
+    // Nothing answers the reset
+    sim_reset();
+    ow_bus_init(&busPin);
+    sim_usart_connect(&busPin);
+    stats_clear();
+
+    if (onewire_reset(&busPin) || stats_bus.presenceFailures != 1) {
+        printf("FAIL uart presence on an empty bus\n");
+        failures++;
+    }
+
+    // Nothing pulls the line up, it reads back as 0x00
+    sim_reset();
+    sim_usart_connect(&busPin);
+    PIND &= ~_BV(PD1);
+
+    if (onewire_reset(&busPin) || stats_bus.presenceFailures != 2) {
+        printf("FAIL uart presence on a shorted bus\n");
+        failures++;
+    }
+
+    return failures;
+}
+
+// Edges of the software transmitter pin
+static uint64_t txEdges[64];
+static uint8_t txEdgeCount;
+static bool txLevel;
+
+static void tx_watch(uint64_t from_ns, uint64_t to_ns)
+{
+    (void) to_ns;
+
+    bool level = (SOFT_TX_PORT & _BV(SOFT_TX_PIN)) != 0;
+
+    if (level != txLevel && txEdgeCount < sizeof(txEdges) / sizeof(txEdges[0])) {
+        txEdges[txEdgeCount++] = from_ns;
+        txLevel = level;
+    }
+}
+
+static int check_soft_tx(void)
+{
+    // The simulation does not count the loop cycles, only the delays
+    uint64_t bit = (SOFT_TX_BIT_CYCLES - SOFT_TX_LOOP_CYCLES) * 1000000000ULL / F_CPU;
+    double baud = (double) F_CPU / SOFT_TX_BIT_CYCLES;
+    uint8_t received[2] = { 0, 0 };
+    int failures = 0;
+
+    sim_reset();
+    USART_Init(MYUBRR);
+    txLevel = true;
+    txEdgeCount = 0;
+    sim_watch(tx_watch);
+
+    USART_TransmitString((unsigned char*) "OK");
+    _delay_ms(1);
+
+    // Level in the middle of each data bit, from the start bit edge
+    uint8_t edge = 0;
+
+    for (uint8_t c = 0; c < 2 && edge < txEdgeCount; ++c) {
+        uint64_t start = txEdges[edge];
+
+        for (uint8_t b = 0; b < 8; ++b) {
+            uint64_t t = start + bit * (b + 1) + bit / 2;
+            uint8_t e = edge;
+
+            while (e < txEdgeCount && txEdges[e] <= t) {
+                e++;
+            }
+
+            // Odd number of edges since the start bit: high
+            if ((e - edge) % 2 == 0) {
+                received[c] |= 1 << b;
+            }
+        }
+
+        // Next start bit after the stop bits
+        while (edge < txEdgeCount && txEdges[edge] < start + bit * 10) {
+            edge++;
+        }
+    }
+
+    printf("soft tx: %.0f baud, %+.2f%%, %u cycles of delay per bit\n",
+        baud, (baud - BAUD) * 100 / BAUD, SOFT_TX_BIT_CYCLES - SOFT_TX_LOOP_CYCLES);
+
+    if (memcmp(received, "OK", 2) != 0) {
+        printf("FAIL soft tx sent %02x %02x\n", received[0], received[1]);
+        failures++;
+    }
+
+    return failures;
+}
+
+int main(void)
+{
+    int failures = 0;
+
+    failures += check_bus();
+    failures += check_reset_failures();
+    failures += check_soft_tx();
+
+    printf("uart: %s\n\n", failures ? "FAIL" : "ok");
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,217 @@
+#include "ook.h"
+#include "sim.h"
+
+#include "defines.h"
+
+// AVR replacements
+#include <avr/io.h>
+
+// C
+#include <string.h>
+
+const ook_ppm_timing ook_timing_prologue = {
+    .pulse = 500,
+    .short_gap = 2000,
+    .long_gap = 4000,
+    .gap_limit = 7000,
+    .reset_limit = 10000,
+    .tolerance = 500,
+};
+
+const ook_ppm_timing ook_timing_nexus = {
+    .pulse = 500,
+    .short_gap = 1000,
+    .long_gap = 2000,
+    .gap_limit = 3000,
+    .reset_limit = 5000,
+    .tolerance = 400,
+};
+
+// Capture state
+static ook_pulses* capture;
+static bool captureLevel;
+static uint64_t captureEdge;
+static uint64_t captureFirst;
+
+static void ook_capture_watch(uint64_t from_ns, uint64_t to_ns)
+{
+    (void) to_ns;
+
+    if (capture == NULL) {
+        return;
+    }
+
+    bool level = (PORT & _BV(PIN_RADIO)) != 0;
+
+    if (level == captureLevel) {
+        return;
+    }
+
+    if (level) {
+        // Rising edge: closes the gap after the previous pulse
+        if (capture->count == 0) {
+            captureFirst = from_ns;
+        } else {
+            capture->gap[capture->count - 1] = (from_ns - captureEdge + 500) / 1000;
+        }
+
+    } else if (capture->count < OOK_MAX_PULSES) {
+        // Falling edge: end of a pulse
+        capture->pulse[capture->count] = (from_ns - captureEdge + 500) / 1000;
+        capture->gap[capture->count] = OOK_GAP_IDLE;
+        capture->airtime = (from_ns - captureFirst + 500) / 1000;
+        capture->count++;
+    }
+
+    captureLevel = level;
+    captureEdge = from_ns;
+}
+
+void ook_capture_start(ook_pulses* pulses)
+{
+    memset(pulses, 0, sizeof(*pulses));
+
+    capture = pulses;
+    captureLevel = (PORT & _BV(PIN_RADIO)) != 0;
+    captureEdge = sim_now();
+
+    sim_watch(ook_capture_watch);
+}
+
+void ook_capture_stop(void)
+{
+    // Catch an edge made right before stopping
+    ook_capture_watch(sim_now(), sim_now());
+
+    if (capture != NULL && capture->count != 0) {
+        capture->gap[capture->count - 1] = OOK_GAP_IDLE;
+    }
+
+    capture = NULL;
+}
+
+static bool within(uint32_t value, uint32_t expected, uint32_t tolerance)
+{
+    uint32_t diff = value > expected ? value - expected : expected - value;
+    return diff <= tolerance;
+}
+
+static void add_bit(ook_bits* bits, uint8_t value)
+{
+    uint8_t row = bits->rows - 1;
+    uint8_t n = bits->bits[row];
+
+    if (n >= OOK_MAX_ROW_BYTES * 8) {
+        return;
+    }
+
+    if (value) {
+        bits->data[row][n / 8] |= 0x80 >> (n % 8);
+    }
+
+    bits->bits[row] = n + 1;
+}
+
+static void end_row(ook_bits* bits)
+{
+    // Only start a new row if the current one is not empty
+    if (bits->bits[bits->rows - 1] != 0 && bits->rows < OOK_MAX_ROWS) {
+        bits->rows++;
+    }
+}
+
+uint8_t ook_demod_ppm(const ook_pulses* pulses, const ook_ppm_timing* timing, ook_bits* bits)
+{
+    memset(bits, 0, sizeof(*bits));
+    bits->rows = 1;
+
+    for (uint16_t i = 0; i < pulses->count; ++i) {
+        uint32_t gap = pulses->gap[i];
+
+        if (timing->pulse != 0 && !within(pulses->pulse[i], timing->pulse, timing->tolerance)) {
+            bits->timing_errors++;
+        }
+
+        if (within(gap, timing->short_gap, timing->tolerance)) {
+            add_bit(bits, 0);
+
+        } else if (within(gap, timing->long_gap, timing->tolerance)) {
+            add_bit(bits, 1);
+
+        } else if (gap > timing->reset_limit) {
+            break;
+
+        } else {
+            // Row gap, or a gap that is neither a symbol nor long enough to be a separator
+            if (gap <= timing->gap_limit) {
+                bits->timing_errors++;
+            }
+
+            end_row(bits);
+        }
+    }
+
+    // Drop the trailing empty row
+    if (bits->bits[bits->rows - 1] == 0) {
+        bits->rows--;
+    }
+
+    return bits->rows;
+}
+
+int ook_find_repeated_row(const ook_bits* bits, uint8_t min_repeats, uint8_t min_bits)
+{
+    for (uint8_t i = 0; i < bits->rows; ++i) {
+        if (bits->bits[i] < min_bits) {
+            continue;
+        }
+
+        uint8_t repeats = 1;
+
+        for (uint8_t j = i + 1; j < bits->rows; ++j) {
+            if (bits->bits[j] == bits->bits[i] &&
+                memcmp(bits->data[i], bits->data[j], (bits->bits[i] + 7) / 8) == 0) {
+                repeats++;
+            }
+        }
+
+        if (repeats >= min_repeats) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+bool prologue_decode(const ook_bits* bits, prologue_reading* reading)
+{
+    if (bits->timing_errors != 0) {
+        return false;
+    }
+
+    int row = ook_find_repeated_row(bits, 4, 36);
+
+    if (row < 0 || bits->bits[row] > 37) {
+        return false;
+    }
+
+    const uint8_t* b = bits->data[row];
+
+    // Type nibble: 9 for the original sensor, 5 for the newer variant
+    reading->type = b[0] >> 4;
+
+    if (reading->type != 9 && reading->type != 5) {
+        return false;
+    }
+
+    reading->id = ((b[0] & 0x0F) << 4) | (b[1] >> 4);
+    reading->battery_ok = (b[1] & 0x08) != 0;
+    reading->button = (b[1] & 0x04) != 0;
+    reading->channel = (b[1] & 0x03) + 1;
+
+    // 12 bit signed value
+    reading->temperature = (int16_t) ((b[2] << 8) | (b[3] & 0xF0)) >> 4;
+    reading->humidity = ((b[3] & 0x0F) << 4) | (b[4] >> 4);
+
+    return true;
+}
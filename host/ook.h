@@ -0,0 +1,112 @@
+#pragma once
+
+// Capture and decoding of the OOK pulse train produced by radio.c in the
+// host simulation, following the demodulation rules of rtl_433
+
+// C
+#include <stdbool.h>
+#include <stdint.h>
+
+#define OOK_MAX_PULSES 1024
+#define OOK_MAX_ROWS 16
+#define OOK_MAX_ROW_BYTES 8
+
+// Gap stored after the last pulse of a capture (the transmitter went idle)
+#define OOK_GAP_IDLE UINT32_MAX
+
+/**
+ * Captured pulse train, durations in microseconds
+ */
+typedef struct ook_pulses {
+    uint16_t count;
+
+    // Length of each pulse (radio on) and of the gap after it (radio off)
+    uint32_t pulse[OOK_MAX_PULSES];
+    uint32_t gap[OOK_MAX_PULSES];
+
+    // Time from the start of the first pulse to the end of the last one
+    uint32_t airtime;
+} ook_pulses;
+
+/**
+ * Pulse position modulation parameters, durations in microseconds
+ */
+typedef struct ook_ppm_timing {
+    // Expected pulse width, 0 to accept any
+    uint32_t pulse;
+
+    // Gap after a "0" and after a "1"
+    uint32_t short_gap;
+    uint32_t long_gap;
+
+    // Gaps longer than this end a row, gaps longer than reset_limit end the message
+    uint32_t gap_limit;
+    uint32_t reset_limit;
+
+    // Allowed deviation of pulses and gaps from the values above
+    uint32_t tolerance;
+} ook_ppm_timing;
+
+/**
+ * Demodulated rows of bits, MSB first (same layout as rtl_433's bitbuffer)
+ */
+typedef struct ook_bits {
+    uint8_t rows;
+    uint8_t bits[OOK_MAX_ROWS];
+    uint8_t data[OOK_MAX_ROWS][OOK_MAX_ROW_BYTES];
+
+    // Number of pulses and gaps that were outside the timing tolerance
+    uint16_t timing_errors;
+} ook_bits;
+
+/**
+ * Reading decoded from a Prologue frame
+ */
+typedef struct prologue_reading {
+    uint8_t type;
+    uint8_t id;
+    uint8_t channel;
+    uint8_t battery_ok;
+    uint8_t button;
+
+    // Celsius x 10
+    int16_t temperature;
+    uint8_t humidity;
+} prologue_reading;
+
+// Timings used by rtl_433 for the Prologue and Nexus decoders
+extern const ook_ppm_timing ook_timing_prologue;
+extern const ook_ppm_timing ook_timing_nexus;
+
+/**
+ * Start recording transitions of the radio pin (PORT, PIN_RADIO in defines.h)
+ * The simulation must have been reset with sim_reset() before.
+ */
+void ook_capture_start(ook_pulses* pulses);
+
+/**
+ * Stop recording and close the last gap with OOK_GAP_IDLE
+ */
+void ook_capture_stop(void);
+
+/**
+ * Demodulate a pulse position modulated pulse train into rows of bits
+ * @returns the number of rows found
+ */
+uint8_t ook_demod_ppm(const ook_pulses* pulses, const ook_ppm_timing* timing, ook_bits* bits);
+
+/**
+ * Find a row that is repeated at least min_repeats times and has at least min_bits
+ * @returns the row index or -1
+ */
+int ook_find_repeated_row(const ook_bits* bits, uint8_t min_repeats, uint8_t min_bits);
+
+/**
+ * Decode a Prologue frame the way rtl_433 does
+ *
+ * A row of 36 or 37 bits must be repeated at least 4 times, and no pulse or
+ * gap may be outside the timing tolerance.
+ *
+ * @returns true if a valid frame was found
+ */
+bool prologue_decode(const ook_bits* bits, prologue_reading* reading);
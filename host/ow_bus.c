@@ -0,0 +1,732 @@
+#include "ow_bus.h"
+#include "sim.h"
+#include "vcd.h"
+
+#include "crc.h"
+
+// C
+#include <stdio.h>
+#include <string.h>
+
+#define US 1000ULL
+
+// A low pulse of at least this length is a reset
+#define OW_RESET_MIN (480 * US)
+
+// Devices sample the line this long after the start of a slot
+#define OW_SAMPLE (15 * US)
+
+// Longest low pulse of a slot (write 0), anything longer up to a reset is
+// a timing error
+#define OW_SLOT_LOW_MAX (120 * US)
+
+// Devices hold the line for this long when sending a zero
+#define OW_TX_ZERO (30 * US)
+
+// Presence pulse timing after the end of a reset
+#define OW_PRESENCE_WAIT (30 * US)
+#define OW_PRESENCE_LENGTH (120 * US)
+
+// Parasite conversions the pull-up resistor alone can power at the same time
+#define OW_WEAK_PULLUP_CONVERSIONS 1
+
+// Device protocol states
+enum {
+    kIdle,
+    kRomCommand,
+    kMatchRom,
+    kSearchBit,
+    kSearchComplement,
+    kSearchDirection,
+    kFunctionCommand,
+    kTransmit,
+    kBusy,
+    kPower,
+    kWriteScratchpad,
+};
+
+// Monitor states
+enum {
+    kMonIdle,
+    kMonRomCommand,
+    kMonMatchRom,
+    kMonSearch,
+    kMonFunctionCommand,
+    kMonData,
+};
+
+static const gpin_t* busPin;
+static const gpin_t* mosfetPin;
+static ow_device devices[OW_MAX_DEVICES];
+static uint8_t deviceCount;
+
+static bool masterLow;
+static uint64_t masterFall;
+static int8_t lineLevel;
+
+static uint32_t slotCount;
+static uint32_t resetCount;
+static uint32_t longSlotCount;
+
+// Trace output
+static bool tracing;
+static uint8_t driveSignal;
+static uint8_t lineSignal;
+static uint8_t protocolSignal;
+
+// Passive decoder state for the annotations
+static uint8_t monState;
+static uint8_t monBits;
+static uint8_t monValue;
+static uint8_t monRom[8];
+static uint8_t monTriplet;
+static uint64_t monStart;
+
+static bool rom_bit(const uint8_t rom[8], uint8_t bit)
+{
+    return (rom[bit / 8] >> (bit % 8)) & 0x1;
+}
+
+static bool device_drives(const ow_device* d, uint64_t t)
+{
+    return t >= d->driveStart && t < d->driveEnd;
+}
+
+static bool line_level(uint64_t t)
+{
+    if (masterLow) {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < deviceCount; ++i) {
+        if (device_drives(&devices[i], t)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Load the temperature into the scratch pad the way the device would
+ * store it after a conversion
+ */
+static void device_convert(ow_device* d)
+{
+    int16_t t = d->temperature;
+    uint16_t raw;
+
+    if (d->rom[0] == 0x10) {
+        // DS1820/DS18S20: 0.5C register plus COUNT_REMAIN (COUNT_PER_C is 16)
+        // T = (raw >> 1) - 0.25 + (16 - COUNT_REMAIN) / 16
+        int16_t half = (t + 4) >> 3;
+        raw = (uint16_t) half;
+        d->scratchpad[6] = 16 - (t - (half >> 1) * 16 + 4);
+        d->scratchpad[7] = 0x10;
+    } else {
+        // The bits below the configured resolution are undefined, leave them set
+        raw = (uint16_t) t;
+    }
+
+    d->scratchpad[0] = raw & 0xFF;
+    d->scratchpad[1] = raw >> 8;
+    d->scratchpad[8] = crc8(d->scratchpad, 8);
+
+    d->conversions++;
+}
+
+static uint64_t device_conversion_time(const ow_device* d)
+{
+    if (d->rom[0] == 0x10) {
+        return 750000 * US;
+    }
+
+    // 93.75ms at 9 bits, doubling for each extra bit
+    return (93750 * US) << ((d->scratchpad[4] >> 5) & 0x3);
+}
+
+static void device_transmit(ow_device* d, const uint8_t* data, uint8_t bits, uint8_t after)
+{
+    memcpy(d->txBuffer, data, (bits + 7) / 8);
+    d->txBits = bits;
+    d->afterTransmit = after;
+    d->state = kTransmit;
+    d->bitCount = 0;
+}
+
+static void device_rom_command(ow_device* d, uint8_t command)
+{
+    int8_t th = (int8_t) d->scratchpad[2];
+    int8_t tl = (int8_t) d->scratchpad[3];
+    int16_t degrees = d->temperature >> 4;
+
+    switch (command) {
+        case 0x33: // Read ROM
+            device_transmit(d, d->rom, 64, kFunctionCommand);
+            break;
+
+        case 0x55: // Match ROM
+            d->state = kMatchRom;
+            d->matched = 1;
+            break;
+
+        case 0xCC: // Skip ROM
+            d->state = kFunctionCommand;
+            break;
+
+        case 0xF0: // Search ROM
+            d->state = kSearchBit;
+            break;
+
+        case 0xEC: // Alarm Search
+            d->state = (degrees > th || degrees < tl) ? kSearchBit : kIdle;
+            break;
+
+        default:
+            d->state = kIdle;
+    }
+}
+
+static void device_function_command(ow_device* d, uint8_t command, uint64_t t)
+{
+    switch (command) {
+        case 0x44: // Convert T
+            device_convert(d);
+            d->busyUntil = t + device_conversion_time(d);
+            d->convertUntil = d->busyUntil;
+            d->state = kBusy;
+            break;
+
+        case 0xBE: // Read Scratchpad
+            device_transmit(d, d->scratchpad, 72, kIdle);
+            break;
+
+        case 0xB4: // Read Power Supply
+            d->state = kPower;
+            break;
+
+        case 0x4E: // Write Scratchpad
+            d->state = kWriteScratchpad;
+            d->matched = 0;
+            break;
+
+        default:
+            d->state = kIdle;
+    }
+}
+
+static void device_receive(ow_device* d, uint8_t bit, uint64_t t)
+{
+    d->byte |= bit << d->bitCount;
+
+    if (++d->bitCount != 8) {
+        return;
+    }
+
+    uint8_t value = d->byte;
+    d->byte = 0;
+    d->bitCount = 0;
+
+    switch (d->state) {
+        case kRomCommand:
+            device_rom_command(d, value);
+            break;
+
+        case kFunctionCommand:
+            device_function_command(d, value, t);
+            break;
+
+        case kWriteScratchpad:
+            // TH, TL and (except on the DS1820) the configuration register
+            d->scratchpad[2 + d->matched++] = value;
+
+            if (d->matched == (d->rom[0] == 0x10 ? 2 : 3)) {
+                d->scratchpad[8] = crc8(d->scratchpad, 8);
+                d->state = kIdle;
+            }
+
+            break;
+    }
+}
+
+/**
+ * Bit the device sends in the slot starting at t, or -1 if it is listening
+ */
+static int8_t device_tx_bit(const ow_device* d, uint64_t t)
+{
+    switch (d->state) {
+        case kTransmit:
+            return rom_bit(d->txBuffer, d->bitCount);
+
+        case kSearchBit:
+            return rom_bit(d->rom, d->bitCount);
+
+        case kSearchComplement:
+            return !rom_bit(d->rom, d->bitCount);
+
+        case kBusy:
+            return t >= d->busyUntil;
+
+        case kPower:
+            return !d->parasite;
+
+        default:
+            return -1;
+    }
+}
+
+static void device_slot_start(ow_device* d, uint64_t t)
+{
+    if (device_tx_bit(d, t) == 0) {
+        d->driveStart = t;
+        d->driveEnd = t + OW_TX_ZERO;
+    }
+}
+
+static void device_slot_end(ow_device* d, uint8_t written, uint64_t t)
+{
+    switch (d->state) {
+        case kTransmit:
+            if (++d->bitCount == d->txBits) {
+                d->state = d->afterTransmit;
+                d->bitCount = 0;
+                d->byte = 0;
+            }
+            break;
+
+        case kSearchBit:
+            d->state = kSearchComplement;
+            break;
+
+        case kSearchComplement:
+            d->state = kSearchDirection;
+            break;
+
+        case kSearchDirection:
+            if (written != rom_bit(d->rom, d->bitCount)) {
+                // Another branch was chosen, wait for the next reset
+                d->state = kIdle;
+            } else if (++d->bitCount == 64) {
+                d->state = kFunctionCommand;
+                d->bitCount = 0;
+            } else {
+                d->state = kSearchBit;
+            }
+            break;
+
+        case kMatchRom:
+            if (written != rom_bit(d->rom, d->bitCount)) {
+                d->matched = 0;
+            }
+
+            if (++d->bitCount == 64) {
+                d->state = d->matched ? kFunctionCommand : kIdle;
+                d->bitCount = 0;
+            }
+            break;
+
+        case kRomCommand:
+        case kFunctionCommand:
+        case kWriteScratchpad:
+            device_receive(d, written, t);
+            break;
+    }
+}
+
+static void device_reset(ow_device* d, uint64_t t)
+{
+    d->state = kRomCommand;
+    d->bitCount = 0;
+    d->byte = 0;
+
+    d->driveStart = t + OW_PRESENCE_WAIT;
+    d->driveEnd = d->driveStart + OW_PRESENCE_LENGTH;
+}
+
+static const char* command_name(uint8_t command, bool rom)
+{
+    if (rom) {
+        switch (command) {
+            case 0x33: return "Read ROM";
+            case 0x55: return "Match ROM";
+            case 0xCC: return "Skip ROM";
+            case 0xF0: return "Search ROM";
+            case 0xEC: return "Alarm Search";
+        }
+    } else {
+        switch (command) {
+            case 0x44: return "Convert T";
+            case 0xBE: return "Read Scratchpad";
+            case 0xB4: return "Read Power Supply";
+            case 0x4E: return "Write Scratchpad";
+            case 0x48: return "Copy Scratchpad";
+            case 0xB8: return "Recall E2";
+        }
+    }
+
+    return "Unknown";
+}
+
+static void annotate(uint64_t t, const char* text)
+{
+    if (tracing) {
+        vcd_text(protocolSignal, t, text);
+    }
+}
+
+static void annotate_rom(uint64_t t, const char* prefix, const uint8_t rom[8])
+{
+    char s[48];
+
+    snprintf(s, sizeof(s), "%s %02x%02x%02x%02x%02x%02x%02x%02x", prefix,
+        rom[0], rom[1], rom[2], rom[3], rom[4], rom[5], rom[6], rom[7]);
+    annotate(t, s);
+}
+
+/**
+ * Decode the value of a completed slot, as a logic analyser would
+ */
+static void monitor_slot(uint8_t value, uint64_t t)
+{
+    char s[48];
+
+    if (monBits == 0) {
+        monStart = t;
+    }
+
+    switch (monState) {
+        case kMonRomCommand:
+        case kMonFunctionCommand:
+        case kMonData:
+            monValue |= value << monBits;
+
+            if (++monBits != 8) {
+                return;
+            }
+
+            if (monState == kMonData) {
+                snprintf(s, sizeof(s), "0x%02x", monValue);
+                annotate(monStart, s);
+
+            } else {
+                bool rom = monState == kMonRomCommand;
+                snprintf(s, sizeof(s), "%s (0x%02x)", command_name(monValue, rom), monValue);
+                annotate(monStart, s);
+
+                if (!rom) {
+                    monState = kMonData;
+                } else if (monValue == 0x55) {
+                    monState = kMonMatchRom;
+                    memset(monRom, 0, sizeof(monRom));
+                } else if (monValue == 0xF0 || monValue == 0xEC) {
+                    monState = kMonSearch;
+                    memset(monRom, 0, sizeof(monRom));
+                    monTriplet = 0;
+                } else if (monValue == 0xCC) {
+                    monState = kMonFunctionCommand;
+                } else {
+                    monState = kMonData;
+                }
+            }
+
+            monBits = 0;
+            monValue = 0;
+            break;
+
+        case kMonMatchRom:
+            monRom[monBits / 8] |= value << (monBits % 8);
+
+            if (++monBits == 64) {
+                annotate_rom(monStart, "ROM", monRom);
+                monState = kMonFunctionCommand;
+                monBits = 0;
+            }
+            break;
+
+        case kMonSearch:
+            // Bit, complement, then the direction chosen by the master
+            monValue |= value << monTriplet;
+
+            if (monTriplet == 0) {
+                monStart = t;
+            }
+
+            if (++monTriplet != 3) {
+                return;
+            }
+
+            if ((monValue & 0x3) == 0x3) {
+                snprintf(s, sizeof(s), "search %u: no devices", monBits);
+                annotate(monStart, s);
+                monState = kMonIdle;
+                break;
+            }
+
+            snprintf(s, sizeof(s), "search %u: %u%u>%u", monBits,
+                monValue & 0x1, (monValue >> 1) & 0x1, monValue >> 2);
+            annotate(monStart, s);
+
+            monRom[monBits / 8] |= (monValue >> 2) << (monBits % 8);
+            monTriplet = 0;
+            monValue = 0;
+
+            if (++monBits == 64) {
+                annotate_rom(t, "found", monRom);
+                monState = kMonFunctionCommand;
+                monBits = 0;
+            }
+            break;
+    }
+}
+
+static void master_fall(uint64_t t)
+{
+    masterFall = t;
+
+    for (uint8_t i = 0; i < deviceCount; ++i) {
+        device_slot_start(&devices[i], t);
+    }
+}
+
+static void master_rise(uint64_t t)
+{
+    uint64_t length = t - masterFall;
+
+    if (length >= OW_RESET_MIN) {
+        resetCount++;
+
+        for (uint8_t i = 0; i < deviceCount; ++i) {
+            device_reset(&devices[i], t);
+        }
+
+        annotate(masterFall, deviceCount ? "reset: presence" : "reset: no presence");
+
+        monState = kMonRomCommand;
+        monBits = 0;
+        monValue = 0;
+        return;
+    }
+
+    slotCount++;
+
+    if (length > OW_SLOT_LOW_MAX) {
+        longSlotCount++;
+        annotate(masterFall, "slot: low too long");
+    }
+
+    // Level seen by the devices and by the master in a read slot
+    uint8_t sample = (length < OW_SAMPLE);
+
+    for (uint8_t i = 0; i < deviceCount; ++i) {
+        if (device_drives(&devices[i], masterFall + OW_SAMPLE)) {
+            sample = 0;
+        }
+    }
+
+    // Short low pulses write a one, long ones a zero
+    uint8_t written = (length < OW_SAMPLE);
+
+    for (uint8_t i = 0; i < deviceCount; ++i) {
+        device_slot_end(&devices[i], written, t);
+    }
+
+    monitor_slot(sample, masterFall);
+}
+
+static void emit_line(uint64_t t)
+{
+    int8_t level = line_level(t);
+
+    if (level != lineLevel) {
+        if (tracing) {
+            vcd_change(lineSignal, t, level);
+        }
+
+        lineLevel = level;
+    }
+}
+
+/**
+ * The device lost its power: it restarts with the power-on scratch pad
+ */
+static void device_brownout(ow_device* d, uint64_t t)
+{
+    if (d->rom[0] == 0x10) {
+        d->scratchpad[0] = 0xAA;
+        d->scratchpad[1] = 0x00;
+        d->scratchpad[6] = 0x0C;
+    } else {
+        d->scratchpad[0] = 0x50;
+        d->scratchpad[1] = 0x05;
+    }
+
+    d->scratchpad[8] = crc8(d->scratchpad, 8);
+    d->convertUntil = 0;
+    d->state = kIdle;
+    d->brownouts++;
+
+    if (tracing) {
+        annotate(t, "brownout");
+    }
+}
+
+/**
+ * Parasite devices converting need the bus held high, by the master pin or
+ * the MOSFET if there is more than one
+ */
+static void check_power(uint64_t t)
+{
+    uint8_t converting = 0;
+
+    for (uint8_t i = 0; i < deviceCount; ++i) {
+        converting += devices[i].parasite && devices[i].convertUntil > t;
+    }
+
+    if (converting == 0) {
+        return;
+    }
+
+    bool strong = ((*busPin->ddr & _BV(busPin->bit)) && (*busPin->port & _BV(busPin->bit))) ||
+        (mosfetPin != NULL && (*mosfetPin->ddr & _BV(mosfetPin->bit)) &&
+            !(*mosfetPin->port & _BV(mosfetPin->bit)));
+
+    if (!masterLow && (strong || converting <= OW_WEAK_PULLUP_CONVERSIONS)) {
+        return;
+    }
+
+    for (uint8_t i = 0; i < deviceCount; ++i) {
+        if (devices[i].parasite && devices[i].convertUntil > t) {
+            device_brownout(&devices[i], t);
+        }
+    }
+}
+
+static void ow_bus_watch(uint64_t from_ns, uint64_t to_ns)
+{
+    bool low = (*busPin->ddr & _BV(busPin->bit)) && !(*busPin->port & _BV(busPin->bit));
+
+    if (low != masterLow) {
+        masterLow = low;
+
+        if (tracing) {
+            vcd_change(driveSignal, from_ns, low);
+        }
+
+        if (low) {
+            master_fall(from_ns);
+        } else {
+            master_rise(from_ns);
+        }
+    }
+
+    check_power(from_ns);
+
+    // Line changes caused by devices during this step
+    emit_line(from_ns);
+
+    for (uint8_t i = 0; i < deviceCount; ++i) {
+        const ow_device* d = &devices[i];
+
+        if (d->driveStart > from_ns && d->driveStart < to_ns) {
+            emit_line(d->driveStart);
+        }
+
+        if (d->driveEnd > from_ns && d->driveEnd < to_ns) {
+            emit_line(d->driveEnd);
+        }
+    }
+
+    // The firmware reads the pin at the end of the step
+    if (line_level(to_ns)) {
+        *busPin->pin |= _BV(busPin->bit);
+    } else {
+        *busPin->pin &= ~_BV(busPin->bit);
+    }
+}
+
+void ow_bus_init(const gpin_t* pin)
+{
+    busPin = pin;
+    mosfetPin = NULL;
+    deviceCount = 0;
+    masterLow = false;
+    lineLevel = -1;
+    slotCount = 0;
+    resetCount = 0;
+    longSlotCount = 0;
+    tracing = false;
+    monState = kMonIdle;
+
+    // Pulled up while idle
+    *busPin->pin |= _BV(busPin->bit);
+
+    sim_watch(ow_bus_watch);
+}
+
+void ow_bus_set_pullup(const gpin_t* mosfet)
+{
+    mosfetPin = mosfet;
+}
+
+ow_device* ow_bus_add(uint8_t family, const uint8_t serial[6], int16_t temperature)
+{
+    if (deviceCount == OW_MAX_DEVICES) {
+        return NULL;
+    }
+
+    ow_device* d = &devices[deviceCount++];
+    memset(d, 0, sizeof(*d));
+
+    d->rom[0] = family;
+    memcpy(&d->rom[1], serial, 6);
+    d->rom[7] = crc8(d->rom, 7);
+
+    // Power-on scratch pad: 85C, TH 75C, TL 70C, 12-bit resolution
+    static const uint8_t powerOn[8] = { 0x50, 0x05, 0x4B, 0x46, 0x7F, 0xFF, 0x0C, 0x10 };
+    memcpy(d->scratchpad, powerOn, 8);
+
+    if (family == 0x10) {
+        // 85C in half degrees, no configuration register
+        d->scratchpad[0] = 0xAA;
+        d->scratchpad[1] = 0x00;
+        d->scratchpad[4] = 0xFF;
+    }
+
+    d->scratchpad[8] = crc8(d->scratchpad, 8);
+    d->temperature = temperature;
+
+    return d;
+}
+
+uint8_t ow_bus_device_count(void)
+{
+    return deviceCount;
+}
+
+ow_device* ow_bus_device(uint8_t index)
+{
+    return index < deviceCount ? &devices[index] : NULL;
+}
+
+void ow_bus_trace(void)
+{
+    driveSignal = vcd_wire("ow_master_low");
+    lineSignal = vcd_wire("ow_line");
+    protocolSignal = vcd_string("ow_protocol");
+    tracing = true;
+}
+
+uint32_t ow_bus_slots(void)
+{
+    return slotCount;
+}
+
+uint32_t ow_bus_resets(void)
+{
+    return resetCount;
+}
+
+uint32_t ow_bus_long_slots(void)
+{
+    return longSlotCount;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+// 1-Wire bus model for the host simulation
+//
+// The bus watches the master pin through the simulated PORT/DDR registers,
+// answers with a set of DS18B20/DS1820 device models and updates the PIN
+// register, so onewire.c and ds18b20.c run unchanged against it. A passive
+// monitor decodes the traffic (reset, ROM and function commands, search
+// triplets, data bytes) into annotations for the VCD dump.
+
+#include "pindef.h"
+
+// C
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef OW_MAX_DEVICES
+#define OW_MAX_DEVICES 8
+#endif
+
+/**
+ * Simulated temperature sensor
+ */
+typedef struct ow_device {
+    uint8_t rom[8];
+    uint8_t scratchpad[9];
+
+    // Temperature used by the next conversion, 1/16 degrees C
+    int16_t temperature;
+
+    // Parasite powered devices answer 0 to Read Power Supply, and lose the
+    // conversion (brown out) if the bus is not held high while it runs
+    bool parasite;
+
+    // Protocol state, see ow_bus.c
+    uint8_t state;
+    uint8_t afterTransmit;
+    uint8_t bitCount;
+    uint8_t byte;
+    uint8_t matched;
+    uint8_t txBuffer[9];
+    uint8_t txBits;
+    uint64_t busyUntil;
+    uint64_t convertUntil;
+
+    // Time window in which the device pulls the line low
+    uint64_t driveStart;
+    uint64_t driveEnd;
+
+    uint16_t conversions;
+    uint16_t brownouts;
+} ow_device;
+
+/**
+ * Connect the bus model to the master pin
+ * Must be called after sim_reset(). Devices are removed.
+ */
+void ow_bus_init(const gpin_t* pin);
+
+/**
+ * Gate pin of a P-channel MOSFET pulling the bus up to VCC when low, or NULL
+ */
+void ow_bus_set_pullup(const gpin_t* mosfet);
+
+/**
+ * Add a device with the given family code and 48-bit serial number
+ * @returns the device, or NULL if the bus is full
+ */
+ow_device* ow_bus_add(uint8_t family, const uint8_t serial[6], int16_t temperature);
+
+uint8_t ow_bus_device_count(void);
+ow_device* ow_bus_device(uint8_t index);
+
+/**
+ * Dump the master drive, the bus line and the decoded traffic to the open VCD
+ * Must be called after vcd_open().
+ */
+void ow_bus_trace(void);
+
+/**
+ * Number of completed slots and resets seen on the bus
+ */
+uint32_t ow_bus_slots(void);
+uint32_t ow_bus_resets(void);
+
+/**
+ * Number of slots whose low pulse was longer than 120uS but too short for
+ * a reset, which devices may take for neither
+ */
+uint32_t ow_bus_long_slots(void);
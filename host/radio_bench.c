@@ -0,0 +1,190 @@
+// Host-side check and benchmark of the radio encoders in radio.c
+//
+// Every frame is sent through the simulated radio pin, captured as a pulse
+// train and decoded with the same rules rtl_433 uses. The benchmark reports
+// how many frames per second the encoder core produces on the host and how
+// long each frame keeps the transmitter busy.
+
+#include "ook.h"
+#include "sim.h"
+
+#include "radio.h"
+
+// C
+#include <stdio.h>
+#include <time.h>
+
+#define BENCH_FRAMES 2000
+
+typedef struct prologue_case {
+    uint8_t id;
+    uint8_t channel;
+    int16_t temperature;
+    uint8_t humidity;
+    uint8_t battery;
+    uint8_t button;
+} prologue_case;
+
+static const prologue_case cases[] = {
+    { 0x01, 1, 215, 11, 1, 0 },
+    { 0x7F, 4, -1, 100, 1, 0 },
+    { 0xA5, 2, -405, 0, 0, 1 },
+    { 0x5A, 3, 1250, 55, 1, 1 },
+    { 0xFF, 1, 0, 99, 1, 0 },
+    { 0x00, 2, -550, 42, 0, 0 },
+};
+
+static ook_pulses pulses;
+static ook_bits bits;
+
+static int check_prologue(const prologue_case* c)
+{
+    prologue_reading reading;
+
+    sim_reset();
+    ook_capture_start(&pulses);
+    prologue_send(c->id, c->channel, c->temperature, c->humidity, c->battery, c->button);
+    ook_capture_stop();
+
+    ook_demod_ppm(&pulses, &ook_timing_prologue, &bits);
+
+    if (!prologue_decode(&bits, &reading)) {
+        printf("FAIL prologue id=%02x: not decoded (%u rows, %u timing errors)\n",
+            c->id, bits.rows, bits.timing_errors);
+        return 1;
+    }
+
+    if (reading.type != 9 || reading.id != c->id || reading.channel != c->channel ||
+        reading.humidity != c->humidity || reading.battery_ok != c->battery ||
+        reading.button != c->button || reading.temperature != c->temperature) {
+        printf("FAIL prologue id=%02x: got id=%02x ch=%u t=%d h=%u bat=%u btn=%u\n",
+            c->id, reading.id, reading.channel, reading.temperature, reading.humidity,
+            reading.battery_ok, reading.button);
+        return 1;
+    }
+
+    return 0;
+}
+
+static int check_tolerance(void)
+{
+    prologue_reading reading;
+
+    sim_reset();
+    ook_capture_start(&pulses);
+    prologue_send(0x42, 1, 200, 50, 1, 0);
+    ook_capture_stop();
+
+    // Stretch every gap by 20%, a "0" then lands between the two symbols
+    for (uint16_t i = 0; i < pulses.count; ++i) {
+        if (pulses.gap[i] != OOK_GAP_IDLE) {
+            pulses.gap[i] += pulses.gap[i] / 5;
+        }
+    }
+
+    ook_demod_ppm(&pulses, &ook_timing_prologue, &bits);
+
+    if (bits.timing_errors == 0 || prologue_decode(&bits, &reading)) {
+        printf("FAIL prologue: out of tolerance timing was accepted\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+static int check_pwm_gap(void)
+{
+    uint8_t bytes[5] = { 0x94, 0x2A, 0x0D, 0x70, 0xB0 };
+    int failures = 0;
+
+    // Two frames back to back, 3 repeats of 37 pulses each
+    sim_reset();
+    ook_capture_start(&pulses);
+    send_pwm(bytes, 37, 3);
+    send_pwm(bytes, 37, 3);
+    ook_capture_stop();
+
+    for (uint16_t i = 36; i < pulses.count - 1; i += 37) {
+        if (pulses.gap[i] + 100 < PWM_TIME_GAP) {
+            printf("FAIL pwm: gap of %u us after repeat %u\n", pulses.gap[i], i / 37);
+            failures++;
+        }
+    }
+
+    if (pulses.count != 2 * 3 * 37) {
+        printf("FAIL pwm: %u pulses\n", pulses.count);
+        failures++;
+    }
+
+    return failures;
+}
+
+static void send_prologue(void)
+{
+    prologue_send(0x42, 2, 215, 11, 1, 0);
+}
+
+static void send_nexus(void)
+{
+    nexus_send(0x42, 2, 215, 11, 1);
+}
+
+static void send_ppm37(void)
+{
+    uint8_t bytes[5] = { 0x94, 0x2A, 0x0D, 0x70, 0xB0 };
+    send_ppm(bytes, 37, 7);
+}
+
+static void send_pwm37(void)
+{
+    uint8_t bytes[5] = { 0x94, 0x2A, 0x0D, 0x70, 0xB0 };
+    send_pwm(bytes, 37, 3);
+}
+
+static void bench(const char* name, void (*send)(void))
+{
+    struct timespec start, end;
+
+    sim_reset();
+    ook_capture_start(&pulses);
+    send();
+    ook_capture_stop();
+
+    uint32_t airtime = pulses.airtime;
+    uint16_t count = pulses.count;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int i = 0; i < BENCH_FRAMES; ++i) {
+        sim_reset();
+        send();
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    printf("%-10s %6u pulses %9.1f ms airtime %12.0f frames/s\n",
+        name, count, airtime / 1000.0, BENCH_FRAMES / seconds);
+}
+
+int main(void)
+{
+    int failures = 0;
+
+    for (unsigned i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        failures += check_prologue(&cases[i]);
+    }
+
+    failures += check_tolerance();
+    failures += check_pwm_gap();
+
+    printf("prologue round trip: %s\n\n", failures ? "FAIL" : "ok");
+
+    bench("prologue", send_prologue);
+    bench("nexus", send_nexus);
+    bench("ppm 37", send_ppm37);
+    bench("pwm 37", send_pwm37);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,270 @@
+// Check of the measurement buffer in samples.c
+//
+// Built twice by build_host.sh: without SAMPLES_EEPROM the SRAM ring must
+// drop the oldest unsent samples when it wraps, with it they must spill into
+// the EEPROM ring and come back, oldest first, after a reset. Both builds
+// send a batch through the simulated radio and decode the frames.
+
+#include "gateway.h"
+#include "ook.h"
+#include "sim.h"
+
+#include "radio.h"
+#include "samples.h"
+
+// C
+#include <stdio.h>
+
+static ook_pulses pulses;
+static ook_bits bits;
+
+static sample_t make_sample(uint16_t n)
+{
+    sample_t sample = { .time = n, .sensor = n % 64, .temperature = (int16_t) (n % 200) * 8 - 400 };
+
+    return sample;
+}
+
+static void push_range(uint16_t first, uint16_t count)
+{
+    for (uint16_t n = first; n < first + count; ++n) {
+        sample_t sample = make_sample(n);
+
+        samples_push(&sample);
+    }
+}
+
+/**
+ * Take all pending samples, they must be first to first + count - 1 in order
+ */
+static int expect_range(const char* name, uint16_t first, uint16_t count)
+{
+    sample_t sample;
+    uint16_t n = first;
+
+    if (samples_pending() != count) {
+        printf("FAIL %s: %u pending, expected %u\n", name, samples_pending(), count);
+        return 1;
+    }
+
+    while (samples_next(&sample)) {
+        sample_t expected = make_sample(n);
+
+        if (sample.time != expected.time || sample.sensor != expected.sensor ||
+            sample.temperature != expected.temperature) {
+            printf("FAIL %s: got sample %u, expected %u\n", name, sample.time, n);
+            return 1;
+        }
+
+        n++;
+    }
+
+    if (n != first + count || samples_pending() != 0) {
+        printf("FAIL %s: %u samples taken, expected %u\n", name, n - first, count);
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * A power cycle: SRAM is lost, the EEPROM is kept
+ */
+static void restart(void)
+{
+    sim_reset();
+    samples_init();
+}
+
+#ifdef SAMPLES_EEPROM
+
+static int check_eeprom(void)
+{
+    int failures = 0;
+
+    sim_eeprom_erase();
+    restart();
+
+    // Unsent samples overwritten in SRAM move to the EEPROM
+    push_range(0, SAMPLES_SIZE + 8);
+
+    if (samples_lost() != 0) {
+        printf("FAIL spill: %u lost\n", samples_lost());
+        failures++;
+    }
+
+    failures += expect_range("spill", 0, SAMPLES_SIZE + 8);
+
+    // After a reset only the EEPROM part is left
+    push_range(100, SAMPLES_SIZE + 8);
+    restart();
+    failures += expect_range("recovery", 100, 8);
+
+    // More spilled samples than EEPROM slots, several times around the 7 bit
+    // sequence numbers: the oldest are lost, the write position is found back
+    for (uint16_t round = 0; round < 4; ++round) {
+        uint16_t first = 1000 + round * 1000;
+        uint16_t spilled = SAMPLES_EEPROM_SLOTS + 10;
+
+        restart();
+        push_range(first, SAMPLES_SIZE + spilled);
+        restart();
+
+        failures += expect_range("eeprom wrap", first + 10, SAMPLES_EEPROM_SLOTS);
+    }
+
+    // Sent samples stay sent after a reset
+    restart();
+    failures += expect_range("sent", 0, 0);
+
+    printf("samples: %u spilled to %u EEPROM slots and recovered\n",
+        4 * (SAMPLES_EEPROM_SLOTS + 10) + 16, SAMPLES_EEPROM_SLOTS);
+
+    return failures;
+}
+
+#else
+
+static int check_ring(void)
+{
+    int failures = 0;
+
+    restart();
+
+    // The ring keeps the newest samples
+    push_range(0, SAMPLES_SIZE + 8);
+
+    if (samples_lost() != 8) {
+        printf("FAIL wrap: %u lost, expected 8\n", samples_lost());
+        failures++;
+    }
+
+    failures += expect_range("wrap", 8, SAMPLES_SIZE);
+
+    // Sent samples are overwritten without loss
+    push_range(100, SAMPLES_SIZE);
+    failures += expect_range("sent", 100, SAMPLES_SIZE);
+
+    if (samples_lost() != 8) {
+        printf("FAIL sent: %u lost, expected 8\n", samples_lost());
+        failures++;
+    }
+
+    printf("samples: %u kept of %u, oldest dropped\n", SAMPLES_SIZE, SAMPLES_SIZE + 8);
+
+    return failures;
+}
+
+#endif
+
+static int check_frames(void)
+{
+    // Two readings of the same sensor, one of them too old for the age field
+    static const sample_t batch[] = {
+        { 10, 5, 21 * 16 + 8 },
+        { 2000, 9, -10 * 16 - 2 },
+        { 2020, 5, 22 * 16 },
+    };
+
+    static const uint16_t now = 2030;
+    static const uint16_t ages[] = { SAMPLES_FRAME_AGE_MAX, 30, 10 };
+
+    int failures = 0;
+
+    restart();
+
+    for (uint8_t i = 0; i < 3; ++i) {
+        samples_push(&batch[i]);
+    }
+
+    ook_capture_start(&pulses);
+    samples_send(now);
+    ook_capture_stop();
+
+    ook_demod_ppm(&pulses, &ook_timing_prologue, &bits);
+
+    // Each frame is repeated, keep the distinct ones
+    uint64_t frames[3];
+    uint8_t count = 0;
+
+    for (uint8_t row = 0; row < bits.rows && count < 3; ++row) {
+        uint64_t frame = gateway_pack(bits.data[row], 64);
+
+        if (bits.bits[row] == 64 && (count == 0 || frames[count - 1] != frame)) {
+            frames[count++] = frame;
+        }
+    }
+
+    if (bits.timing_errors != 0 || count != 2) {
+        printf("FAIL frames: %u frames, %u timing errors\n", count, bits.timing_errors);
+        return 1;
+    }
+
+    // The gateway decoder, two readings per frame
+    gateway_readings readings;
+
+    if (!gateway_readings_alloc(&readings, 4)) {
+        printf("out of memory\n");
+        return 1;
+    }
+
+    if (gateway_decode_batch(frames, 2, &readings) != 2) {
+        printf("FAIL frames: not decoded\n");
+        failures++;
+    }
+
+    for (uint8_t i = 0; i < readings.count; ++i) {
+        if (i == 3) {
+            if (readings.flags[i] & GATEWAY_VALID) {
+                printf("FAIL frames: last field not empty\n");
+                failures++;
+            }
+        } else if (readings.flags[i] != GATEWAY_VALID || readings.id[i] != batch[i].sensor ||
+            readings.age[i] != ages[i] || readings.temperature[i] != (batch[i].temperature * 10) / 16) {
+            printf("FAIL frames: field %u sensor %u age %u t=%d\n", i, readings.id[i],
+                readings.age[i], readings.temperature[i]);
+            failures++;
+        }
+    }
+
+    gateway_readings_free(&readings);
+
+    // Airtime of the batch against one Prologue frame per sample
+    uint32_t batchAirtime = pulses.airtime;
+
+    restart();
+    ook_capture_start(&pulses);
+
+    for (uint8_t i = 0; i < 3; ++i) {
+        prologue_send(batch[i].sensor >> 2, batch[i].sensor & 0x03, (batch[i].temperature * 10) / 16, 11, 1, 0);
+    }
+
+    ook_capture_stop();
+
+    printf("samples: 3 sent in 2 frames, %.1f ms of airtime (%.1f ms as Prologue frames)\n",
+        batchAirtime / 1000.0, pulses.airtime / 1000.0);
+
+    if (batchAirtime >= pulses.airtime) {
+        printf("FAIL frames: batch takes longer than single frames\n");
+        failures++;
+    }
+
+    return failures;
+}
+
+int main(void)
+{
+    int failures = 0;
+
+#ifdef SAMPLES_EEPROM
+    failures += check_eeprom();
+#else
+    failures += check_ring();
+#endif
+
+    failures += check_frames();
+
+    printf("samples: %s\n\n", failures ? "FAIL" : "ok");
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,209 @@
+// Check of the sensor registry in sensors.c on a large simulated bus
+//
+// More devices than SENSORS_MAX are searched, converted and read the way
+// main.c does it. Every ROM code must come back unchanged from the compressed
+// form, handles must stay the same from one scan to the next, and devices
+// past the end of the registry (or of an unknown family) must be rejected.
+
+#include "ow_bus.h"
+#include "sim.h"
+
+#include "crc.h"
+#include "ds18b20.h"
+#include "onewire.h"
+#include "sensors.h"
+
+// AVR replacements
+#include <avr/io.h>
+
+// C
+#include <stdio.h>
+#include <string.h>
+
+// Devices of a family sensors.c can't compress
+#define UNKNOWN_FAMILY 0x26
+#define UNKNOWN_COUNT 2
+
+#define DEVICE_COUNT (SENSORS_MAX + 8)
+
+static const uint8_t families[] = { 0x28, 0x28, 0x10, 0x22, 0x3B };
+
+/**
+ * Search the bus and register every device
+ * @returns the number of devices rejected by the registry
+ */
+static unsigned scan(const gpin_t* pin)
+{
+    onewire_search_state search;
+    unsigned rejected = 0;
+
+    onewire_search_init(&search);
+    sensors_begin_scan();
+
+    while (onewire_search(pin, &search)) {
+        if (onewire_check_rom_crc(&search) && sensors_add(search.address) == SENSORS_NONE) {
+            rejected++;
+        }
+    }
+
+    return rejected;
+}
+
+static int check_roms(void)
+{
+    int failures = 0;
+    uint8_t rom[8];
+
+    for (sensor_t s = 0; s < sensors_count(); ++s) {
+        sensors_rom(s, rom);
+
+        if (sensors_find(rom) != s || sensors_family(s) != rom[0]) {
+            printf("FAIL handle %u not found back\n", s);
+            failures++;
+            continue;
+        }
+
+        bool onBus = false;
+
+        for (uint8_t i = 0; i < ow_bus_device_count(); ++i) {
+            onBus |= memcmp(ow_bus_device(i)->rom, rom, 8) == 0;
+        }
+
+        if (!onBus) {
+            printf("FAIL handle %u: %02x..%02x is not on the bus\n", s, rom[0], rom[7]);
+            failures++;
+        }
+    }
+
+    return failures;
+}
+
+static int read_all(const gpin_t* pin, uint16_t now)
+{
+    int failures = 0;
+    uint8_t rom[8];
+
+    ds18b20_convert_wait(pin, NULL, kDS18B20_ConvertParallel);
+
+    for (sensor_t s = 0; s < sensors_count(); ++s) {
+        if (!(sensors_status(s) & SENSOR_PRESENT)) {
+            continue;
+        }
+
+        sensors_rom(s, rom);
+
+        uint8_t resolution = sensors_resolution(s);
+        int16_t reading = ds18b20_read_slave_mode(pin, rom, sensors_read_mode(s), &resolution);
+
+        sensors_set_resolution(s, resolution);
+
+        STATS_INC(sensors_stats(s)->reads);
+        sensors_set_reading(s, reading, now);
+
+        for (uint8_t i = 0; i < ow_bus_device_count(); ++i) {
+            const ow_device* d = ow_bus_device(i);
+
+            if (memcmp(d->rom, rom, 8) == 0 && d->temperature != reading) {
+                printf("FAIL handle %u: %04x, expected %04x\n", s, (uint16_t) reading, (uint16_t) d->temperature);
+                failures++;
+            }
+        }
+    }
+
+    return failures;
+}
+
+int main(void)
+{
+    const gpin_t sensorPin = { &PORTC, &PINC, &DDRC, PC2 };
+    int failures = 0;
+
+    sim_reset();
+    ow_bus_init(&sensorPin);
+    sensors_init();
+
+    for (unsigned i = 0; i < DEVICE_COUNT; ++i) {
+        uint8_t family = i < UNKNOWN_COUNT ? UNKNOWN_FAMILY : families[i % sizeof(families)];
+        uint8_t serial[6] = { i * 37, i, 0x5A, i >> 3, 0x02, 0x00 };
+
+        // DS1820 readings are 1/16 degree steps from 0.5 degree steps and COUNT_REMAIN
+        ow_bus_add(family, serial, (int16_t) (i * 29 % 800) - 200);
+    }
+
+    unsigned rejected = scan(&sensorPin);
+    unsigned expectedRejected = DEVICE_COUNT - SENSORS_MAX;
+
+#ifdef SENSORS_FULL_ROM
+    const char* layout = "full ROM codes";
+#else
+    const char* layout = "compressed ROM codes";
+#endif
+
+    printf("sensors: %u of %u devices registered (%s), %u rejected\n",
+        sensors_count(), DEVICE_COUNT, layout, rejected);
+
+    if (sensors_count() != SENSORS_MAX || rejected != expectedRejected) {
+        printf("FAIL expected %u sensors and %u rejected\n", SENSORS_MAX, expectedRejected);
+        failures++;
+    }
+
+#ifndef SENSORS_FULL_ROM
+    // Unknown families are rejected before the registry is full
+    uint8_t unknown[8] = { UNKNOWN_FAMILY, 1, 2, 3, 4, 5, 6, 0 };
+
+    if (sensors_find(unknown) != SENSORS_NONE) {
+        printf("FAIL unknown family found\n");
+        failures++;
+    }
+#endif
+
+    failures += check_roms();
+
+    uint64_t start = sim_now();
+
+    failures += read_all(&sensorPin, 1);
+
+    printf("sensors: %u read in %.1f ms of bus time\n", sensors_count(), (sim_now() - start) / 1e6);
+
+    // A new scan keeps the handles and the readings
+    uint8_t before[8], after[8];
+
+    sensors_rom(SENSORS_MAX / 2, before);
+    scan(&sensorPin);
+    sensors_rom(SENSORS_MAX / 2, after);
+
+    if (sensors_count() != SENSORS_MAX || memcmp(before, after, 8) != 0 ||
+        !(sensors_status(SENSORS_MAX / 2) & SENSOR_VALID) || sensors_time(SENSORS_MAX / 2) != 1) {
+        printf("FAIL handles changed by a new scan\n");
+        failures++;
+    }
+
+    // A sensor missing from a scan keeps its handle but is no longer present
+    sensor_t gone = 3;
+    uint8_t rom[8];
+
+    sensors_rom(gone, rom);
+
+    for (uint8_t i = 0; i < ow_bus_device_count(); ++i) {
+        ow_device* d = ow_bus_device(i);
+
+        if (memcmp(d->rom, rom, 8) == 0) {
+            d->rom[6] ^= 0xFF;
+            d->rom[7] = crc8(d->rom, 7);
+        }
+    }
+
+    scan(&sensorPin);
+
+    if (sensors_count() != SENSORS_MAX || sensors_find(rom) != gone ||
+        (sensors_status(gone) & SENSOR_PRESENT) || !(sensors_status(gone + 1) & SENSOR_PRESENT)) {
+        printf("FAIL missing sensor still present\n");
+        failures++;
+    }
+
+    printf("sensors: %u bytes of RAM on the ATmega328P (%u bytes per sensor)\n",
+        SENSORS_MAX * SENSORS_BYTES_PER_SENSOR, SENSORS_BYTES_PER_SENSOR);
+    printf("sensors: %s\n\n", failures ? "FAIL" : "ok");
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,369 @@
+#include "sim.h"
+
+// AVR replacements
+#include <avr/eeprom.h>
+#include <avr/io.h>
+#include <util/delay.h>
+#include <util/delay_basic.h>
+
+// C
+#include <stdbool.h>
+#include <string.h>
+
+#define SIM_MAX_WATCHERS 8
+
+volatile uint8_t PORTB, PINB, DDRB;
+volatile uint8_t PORTC, PINC, DDRC;
+volatile uint8_t PORTD, PIND, DDRD;
+
+volatile uint8_t SREG;
+
+volatile uint8_t UCSR0B, UCSR0C, UBRR0H, UBRR0L;
+
+volatile uint8_t TCCR1A, TCCR1B;
+volatile uint16_t TCNT1;
+
+uint8_t sim_eeprom[E2END + 1];
+
+static uint64_t now_ns;
+static sim_watcher_t watchers[SIM_MAX_WATCHERS];
+static uint8_t watcherCount;
+static sim_io_watcher_t ioWatcher;
+
+// USART0 (UCSR0A, UDR0) and the line it is connected to
+static volatile uint8_t usartStatus;
+static volatile uint8_t usartData;
+static const gpin_t* usartLine;
+static uint8_t usartReceived;
+static bool usartReceiveFull;
+static bool usartReceiveReported;
+static bool usartTransmitPending;
+
+// Interrupt injection
+static uint64_t irqPeriod;
+static uint64_t irqMax;
+static uint64_t irqNext;
+static uint32_t irqSeed;
+static uint32_t irqCount;
+static bool irqPending;
+static uint64_t maskedSince;
+static uint64_t maskedMax;
+
+uint64_t sim_now(void)
+{
+    return now_ns;
+}
+
+void sim_reset(void)
+{
+    now_ns = 0;
+    watcherCount = 0;
+    ioWatcher = NULL;
+
+    PORTB = PINB = DDRB = 0;
+    PORTC = PINC = DDRC = 0;
+    PORTD = PIND = DDRD = 0;
+
+    // Transmit buffer always empty, nothing received
+    usartStatus = _BV(UDRE0);
+    usartLine = NULL;
+    usartReceiveFull = false;
+    usartReceiveReported = false;
+    usartTransmitPending = false;
+
+    TCCR1A = TCCR1B = 0;
+    TCNT1 = 0;
+
+    SREG = 0;
+    irqPeriod = 0;
+    irqPending = false;
+    irqCount = 0;
+    maskedMax = 0;
+}
+
+int sim_watch(sim_watcher_t watcher)
+{
+    for (uint8_t i = 0; i < watcherCount; ++i) {
+        if (watchers[i] == watcher) {
+            return 0;
+        }
+    }
+
+    if (watcherCount == SIM_MAX_WATCHERS) {
+        return -1;
+    }
+
+    watchers[watcherCount++] = watcher;
+    return 0;
+}
+
+void sim_io_watch(sim_io_watcher_t watcher)
+{
+    ioWatcher = watcher;
+}
+
+void sim_eeprom_erase(void)
+{
+    memset(sim_eeprom, 0xFF, sizeof(sim_eeprom));
+}
+
+/**
+ * Timer1 in normal mode, counting the CPU clock through its prescaler
+ */
+static void timer1_update(void)
+{
+    static const uint16_t prescalers[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+    uint16_t prescaler = prescalers[TCCR1B & (_BV(CS12) | _BV(CS11) | _BV(CS10))];
+
+    if (prescaler != 0) {
+        uint64_t cycles = now_ns / 1000 * (F_CPU / 1000000UL) + now_ns % 1000 * (F_CPU / 1000000UL) / 1000;
+
+        TCNT1 = (uint16_t) (cycles / prescaler);
+    }
+}
+
+static void sim_step(uint64_t ns)
+{
+    uint64_t from = now_ns;
+
+    now_ns += ns;
+    timer1_update();
+
+    for (uint8_t i = 0; i < watcherCount; ++i) {
+        watchers[i](from, now_ns);
+    }
+}
+
+static uint32_t irq_random(void)
+{
+    // xorshift32
+    irqSeed ^= irqSeed << 13;
+    irqSeed ^= irqSeed >> 17;
+    irqSeed ^= irqSeed << 5;
+
+    return irqSeed;
+}
+
+static void irq_schedule(void)
+{
+    irqNext = now_ns + 1 + irq_random() % (2 * irqPeriod);
+}
+
+/**
+ * Run an interrupt: time passes, the pins keep their state
+ */
+static void irq_run(void)
+{
+    irqPending = false;
+    irqCount++;
+    sim_step(1 + irq_random() % irqMax);
+    irq_schedule();
+}
+
+void sim_irq_inject(uint64_t period_ns, uint64_t max_ns, uint32_t seed)
+{
+    irqPeriod = period_ns;
+    irqMax = max_ns;
+    irqSeed = seed ? seed : 1;
+    irqPending = false;
+    irqCount = 0;
+    maskedMax = 0;
+
+    if (irqPeriod != 0) {
+        SREG |= _BV(SREG_I);
+        irq_schedule();
+    }
+}
+
+uint32_t sim_irq_count(void)
+{
+    return irqCount;
+}
+
+uint64_t sim_irq_max_masked(void)
+{
+    return maskedMax;
+}
+
+uint8_t sim_irq_disable(void)
+{
+    if (SREG & _BV(SREG_I)) {
+        maskedSince = now_ns;
+    }
+
+    SREG &= ~_BV(SREG_I);
+
+    return 1;
+}
+
+void sim_irq_restore(const uint8_t* sreg)
+{
+    SREG = *sreg;
+
+    if (SREG & _BV(SREG_I)) {
+        if (now_ns - maskedSince > maskedMax) {
+            maskedMax = now_ns - maskedSince;
+        }
+
+        // An interrupt that came in while masked runs now
+        if (irqPending) {
+            irq_run();
+        }
+    }
+}
+
+void sim_irq_enable(const uint8_t* sreg)
+{
+    uint8_t on = *sreg | _BV(SREG_I);
+
+    sim_irq_restore(&on);
+}
+
+void sim_advance_ns(uint64_t ns)
+{
+    uint64_t end = now_ns + ns;
+
+    // Interrupts due during this step run in the middle of it
+    while (irqPeriod != 0 && irqNext < end) {
+        if (!(SREG & _BV(SREG_I))) {
+            irqPending = true;
+            irqNext = UINT64_MAX;
+            break;
+        }
+
+        uint64_t before = now_ns < irqNext ? irqNext - now_ns : 0;
+
+        sim_step(before);
+        end -= now_ns;
+        irq_run();
+        end += now_ns;
+    }
+
+    sim_step(end - now_ns);
+}
+
+void sim_usart_connect(const gpin_t* line)
+{
+    usartLine = line;
+}
+
+/**
+ * Send a frame on the connected line and receive it back
+ *
+ * The frame takes its full time, the CPU waits for it: the firmware only
+ * polls the status while a frame is on the line.
+ */
+static void usart_frame(uint8_t data)
+{
+    uint16_t ubrr = (UBRR0H << 8) | UBRR0L;
+    uint64_t bit = (ubrr + 1ULL) * ((usartStatus & _BV(U2X0)) ? 8 : 16) * 1000000000ULL / F_CPU;
+    uint16_t frame = 0x200 | (data << 1);
+    uint8_t mask = _BV(usartLine->bit);
+
+    usartReceived = 0;
+
+    // Start bit, 8 data bits LSB first and a stop bit, sampled in the middle
+    for (uint8_t i = 0; i < 10; ++i) {
+        // TXD only pulls the line low (open drain buffer)
+        if (frame & (1 << i)) {
+            *usartLine->ddr &= ~mask;
+        } else {
+            *usartLine->port &= ~mask;
+            *usartLine->ddr |= mask;
+        }
+
+        sim_advance_ns(bit / 2);
+
+        if (i >= 1 && i <= 8 && (*usartLine->pin & mask)) {
+            usartReceived |= 1 << (i - 1);
+        }
+
+        sim_advance_ns(bit - bit / 2);
+    }
+
+    usartReceiveFull = true;
+}
+
+/**
+ * Send the byte written to UDR0 since the last access, if any
+ */
+static void usart_update(void)
+{
+    if (usartTransmitPending) {
+        usartTransmitPending = false;
+
+        if (usartLine != NULL && (UCSR0B & _BV(TXEN0))) {
+            usart_frame(usartData);
+        }
+    }
+}
+
+volatile uint8_t* sim_usart_status(void)
+{
+    usart_update();
+
+    usartStatus = (usartStatus & ~_BV(RXC0)) | _BV(UDRE0);
+
+    // The firmware reads UDR0 next, with the received byte in it
+    if (usartReceiveFull) {
+        usartStatus |= _BV(RXC0);
+        usartData = usartReceived;
+        usartReceiveReported = true;
+    }
+
+    return &usartStatus;
+}
+
+volatile uint8_t* sim_usart_data(void)
+{
+    usart_update();
+
+    // Right after RXC0 was seen this is a read, anything else is a write,
+    // sent on the next access once the value is in usartData
+    if (usartReceiveReported) {
+        usartReceiveReported = false;
+        usartReceiveFull = false;
+    } else {
+        usartTransmitPending = true;
+    }
+
+    return &usartData;
+}
+
+volatile uint8_t* sim_io(volatile uint8_t* reg, uint8_t cycles)
+{
+    sim_advance_cycles(cycles);
+
+    if (ioWatcher != NULL) {
+        ioWatcher(reg);
+    }
+
+    return reg;
+}
+
+void sim_advance_cycles(uint64_t cycles)
+{
+    sim_advance_ns(cycles * 1000000000ULL / F_CPU);
+}
+
+void _delay_us(double us)
+{
+    sim_advance_ns((uint64_t) (us * 1000.0 + 0.5));
+}
+
+void _delay_ms(double ms)
+{
+    sim_advance_ns((uint64_t) (ms * 1000000.0 + 0.5));
+}
+
+void _delay_loop_1(uint8_t count)
+{
+    // 3 cycles per iteration, 0 means 256
+    sim_advance_cycles(3 * (count == 0 ? 256 : count));
+}
+
+void _delay_loop_2(uint16_t count)
+{
+    // 4 cycles per iteration, 0 means 65536
+    sim_advance_cycles(4 * (count == 0 ? 65536 : (uint32_t) count));
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+// Host-side simulation of the AVR environment
+//
+// Firmware sources are compiled unchanged against the replacement headers in
+// this directory. I/O registers are plain variables and every delay advances
+// a virtual clock. Peripherals (radio capture, bus models) register a watcher
+// which is called for each time step; as the firmware only changes pins
+// between delays, watchers see every transition with an exact timestamp.
+
+#include "pindef.h"
+
+// C
+#include <stdint.h>
+
+/**
+ * Called for every step of the virtual clock
+ * Pin states are constant during [from_ns, to_ns).
+ */
+typedef void (*sim_watcher_t)(uint64_t from_ns, uint64_t to_ns);
+
+/**
+ * Current virtual time in nanoseconds
+ */
+uint64_t sim_now(void);
+
+/**
+ * Reset the clock, the I/O registers and remove all watchers
+ */
+void sim_reset(void);
+
+/**
+ * Erase the simulated EEPROM (all 0xFF)
+ * The EEPROM keeps its contents across sim_reset(), like a power cycle.
+ */
+void sim_eeprom_erase(void);
+
+/**
+ * Called for every sim_io() access, once the clock has advanced
+ */
+typedef void (*sim_io_watcher_t)(volatile uint8_t* reg);
+
+/**
+ * Register a watcher, returns 0 on success
+ * Registering the same watcher twice has no effect.
+ */
+int sim_watch(sim_watcher_t watcher);
+
+/**
+ * Set the sim_io() watcher, NULL for none
+ */
+void sim_io_watch(sim_io_watcher_t watcher);
+
+/**
+ * Inject interrupts at random times, on average one every period_ns, each
+ * running for up to max_ns. This sets the interrupt flag in SREG. While the
+ * flag is clear (ATOMIC_BLOCK) an interrupt is held back and runs when the
+ * flag is restored, like on the AVR. A period of 0 stops the injection.
+ */
+void sim_irq_inject(uint64_t period_ns, uint64_t max_ns, uint32_t seed);
+
+/**
+ * Number of injected interrupts that ran
+ */
+uint32_t sim_irq_count(void);
+
+/**
+ * Longest time interrupts were disabled, in nanoseconds
+ * This is the latency the firmware adds to an interrupt.
+ */
+uint64_t sim_irq_max_masked(void);
+
+/**
+ * Connect USART0 to a pin, TXD pulling it low through an open drain buffer
+ * and RXD reading it back: the 1-Wire bus of onewire_uart.c
+ *
+ * Every byte written to UDR0 is sent at the rate set in UBRR0 and U2X0 and
+ * received back. Unconnected (after sim_reset()), the USART drops what is
+ * written and never receives anything.
+ */
+void sim_usart_connect(const gpin_t* line);
+
+/**
+ * Advance the virtual clock
+ */
+void sim_advance_ns(uint64_t ns);
+
+/**
+ * Advance the virtual clock by a number of CPU cycles at F_CPU
+ */
+void sim_advance_cycles(uint64_t cycles);
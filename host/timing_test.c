@@ -0,0 +1,392 @@
+// Slot and pulse timings at the F_CPU this is built with
+//
+// build_host.sh builds it at 1, 2, 4, 8 and 16 MHz, with the fixed bus pin
+// mapped through sim_io() so every sbi/cbi and in costs its cycles. The
+// edges and samples of each 1-Wire slot are then taken from the simulation
+// of onewire.c and checked against the windows of the DS18B20 datasheet,
+// the radio pulses and gaps are taken from the captured pulse train. The
+// USART backend is checked from its baud rates. The bus and radio models
+// finally check that this build still reads the sensors and sends
+// decodable frames at this clock.
+
+#include "gateway.h"
+#include "ook.h"
+#include "ow_bus.h"
+#include "sim.h"
+
+#include "ds18b20.h"
+#include "onewire.h"
+#include "onewire_timing.h"
+#include "radio.h"
+#include "usart.h"
+
+// AVR replacements
+#include <avr/io.h>
+#include <util/delay.h>
+
+// C
+#include <math.h>
+#include <stdio.h>
+
+#ifndef ONEWIRE_PORT
+#error "build with the fixed pin, see build_host.sh"
+#endif
+
+/**
+ * Times from the falling edge of each slot, in microseconds
+ */
+typedef struct slot_timings {
+    double resetLow;
+    double presence;
+    double resetRelease;
+    double write1Low;
+    double write1Slot;
+    double write0Low;
+    double write0Slot;
+    double readLow;
+    double readSample;
+    double readSlot;
+} slot_timings;
+
+#define MAX_EDGES 8
+
+// Edges the master made on the bus pin and times it sampled the pin, ns
+static uint64_t falls[MAX_EDGES];
+static uint64_t rises[MAX_EDGES];
+static uint64_t samples[MAX_EDGES];
+static uint8_t fallCount;
+static uint8_t riseCount;
+static uint8_t sampleCount;
+static bool masterLow;
+
+static void record(uint64_t* edges, uint8_t* count, uint64_t t)
+{
+    if (*count < MAX_EDGES) {
+        edges[(*count)++] = t;
+    }
+}
+
+static void watch_edges(uint64_t from_ns, uint64_t to_ns)
+{
+    (void) to_ns;
+
+    bool low = (DDRC & _BV(PC2)) != 0;
+
+    if (low != masterLow) {
+        record(low ? falls : rises, low ? &fallCount : &riseCount, from_ns);
+        masterLow = low;
+    }
+}
+
+static void watch_samples(volatile uint8_t* reg)
+{
+    if (reg == &PINC) {
+        record(samples, &sampleCount, sim_now());
+    }
+}
+
+static double to_us(uint64_t ns)
+{
+    return ns / 1000.0;
+}
+
+/**
+ * Edges of the slots of onewire.c, simulated with the pin accesses charged
+ *
+ * A reset, a write 1, a write 0, a read and a last write 1 whose falling
+ * edge ends the read slot. Nothing runs between the primitives, so the slots
+ * are as short as onewire.c makes them.
+ * @returns false if the simulation did not make the expected edges
+ */
+static bool measure_slots(slot_timings* t)
+{
+    const gpin_t pin = { &PORTC, &PINC, &DDRC, PC2 };
+
+    sim_reset();
+    fallCount = riseCount = sampleCount = 0;
+    masterLow = false;
+    sim_watch(watch_edges);
+    sim_io_watch(watch_samples);
+
+    onewire_reset(&pin);
+    onewire_write_bit(&pin, 1);
+    onewire_write_bit(&pin, 0);
+    onewire_read_bit(&pin);
+    onewire_write_bit(&pin, 1);
+
+    if (fallCount != 5 || riseCount != 5 || sampleCount != 2) {
+        printf("FAIL simulation: %u falling, %u rising edges, %u samples\n", fallCount, riseCount, sampleCount);
+        return false;
+    }
+
+    t->resetLow = to_us(rises[0] - falls[0]);
+    t->presence = to_us(samples[0] - rises[0]);
+    t->resetRelease = to_us(falls[1] - rises[0]);
+    t->write1Low = to_us(rises[1] - falls[1]);
+    t->write1Slot = to_us(falls[2] - falls[1]);
+    t->write0Low = to_us(rises[2] - falls[2]);
+    t->write0Slot = to_us(falls[3] - falls[2]);
+    t->readLow = to_us(rises[3] - falls[3]);
+    t->readSample = to_us(samples[1] - falls[3]);
+    t->readSlot = to_us(falls[4] - falls[3]);
+
+    return true;
+}
+
+/**
+ * Edges of the slots of onewire_uart.c: each slot is a frame with the start
+ * bit low, the receiver samples the middle of the first data bit
+ */
+static void model_uart(slot_timings* t)
+{
+    double bit = 1e6 * 8 * (ONEWIRE_UBRR(115200) + 1) / F_CPU;
+    double resetBit = 1e6 * 8 * (ONEWIRE_UBRR(9600) + 1) / F_CPU;
+
+    // 0xF0: start bit and 4 zeros low, 4 ones and the stop bit high, the
+    // first one is sampled half a bit after the release
+    t->resetLow = 5 * resetBit;
+    t->presence = 0.5 * resetBit;
+    t->resetRelease = 5 * resetBit;
+    t->write1Low = bit;
+    t->write1Slot = 10 * bit;
+    t->write0Low = 9 * bit;
+    t->write0Slot = 10 * bit;
+    t->readLow = bit;
+    t->readSample = 1.5 * bit;
+    t->readSlot = 10 * bit;
+}
+
+static int check_window(const char* path, const char* what, double us, double min, double max)
+{
+    if (us < min || us > max) {
+        printf("FAIL %s %s: %.2f us, must be %.0f - %.0f us\n", path, what, us, min, max);
+        return 1;
+    }
+
+    return 0;
+}
+
+static int check_slots(const char* path, const slot_timings* t, bool uart)
+{
+    int failures = 0;
+
+    failures += check_window(path, "reset low", t->resetLow, 480, 1e9);
+    failures += check_window(path, "reset release", t->resetRelease, 480, 1e9);
+    failures += check_window(path, "write 1 low", t->write1Low, 1, 15);
+    failures += check_window(path, "write 0 low", t->write0Low, 60, 120);
+    failures += check_window(path, "read low", t->readLow, 1, 1e9);
+    failures += check_window(path, "read sample", t->readSample, 0, 14.99);
+
+    // The UART sees the presence pulse anywhere in the high part of the frame
+    if (!uart) {
+        failures += check_window(path, "presence sample", t->presence, 60, 75);
+    }
+
+    // A slot and at least 1 uS of recovery
+    failures += check_window(path, "write 1 slot", t->write1Slot, 61, 1e9);
+    failures += check_window(path, "write 0 slot", t->write0Slot, 61, 1e9);
+    failures += check_window(path, "read slot", t->readSlot, 61, 1e9);
+
+    printf("%-9s reset %5.1f/%4.1f  write 1 %4.1f/%5.1f  write 0 %5.1f/%5.1f  read %4.1f/%4.1f/%5.1f  %s\n",
+        path, t->resetLow, t->presence, t->write1Low, t->write1Slot, t->write0Low, t->write0Slot,
+        t->readLow, t->readSample, t->readSlot, !failures ? "ok" : "FAIL");
+
+    return failures;
+}
+
+/**
+ * Pulse or gap of the captured train against the targets of its protocol
+ *
+ * The simulation charges the delay loops, the cycles radio_emit() spends
+ * around them are added from radio.h.
+ */
+static int check_radio_time(const char* name, const char* what, uint32_t captured, unsigned cycles,
+    const unsigned targets[2])
+{
+    double us = captured + cycles * 1e6 / F_CPU;
+
+    // rtl_433 accepts far more, this is what the clock resolution allows
+    for (unsigned i = 0; i < 2; ++i) {
+        if (fabs(us - targets[i]) <= targets[i] * 0.01) {
+            return 0;
+        }
+    }
+
+    printf("FAIL radio %s %s: %.1f us, targets %u and %u us\n", name, what, us, targets[0], targets[1]);
+    return 1;
+}
+
+/**
+ * Every pulse and every data gap of a frame, gaps longer than gapLimit
+ * (sync, repeat and trailer gaps) are left to the decoders
+ */
+static int check_radio_train(const char* name, void (*send)(void), const unsigned pulseTargets[2],
+    const unsigned gapTargets[2], uint32_t gapLimit)
+{
+    static ook_pulses pulses;
+    int failures = 0;
+
+    sim_reset();
+    ook_capture_start(&pulses);
+    send();
+    ook_capture_stop();
+
+    for (uint16_t i = 0; i < pulses.count && failures < 4; ++i) {
+        failures += check_radio_time(name, "pulse", pulses.pulse[i], RADIO_PULSE_CYCLES, pulseTargets);
+
+        if (pulses.gap[i] <= gapLimit) {
+            failures += check_radio_time(name, "gap", pulses.gap[i], RADIO_GAP_CYCLES, gapTargets);
+        }
+    }
+
+    return failures;
+}
+
+static void send_prologue(void)
+{
+    prologue_send(0x5A, 3, -405, 55, 1, 1);
+}
+
+static void send_nexus(void)
+{
+    nexus_send(0xC3, 2, 1250, 42, 0);
+}
+
+static void send_pwm37(void)
+{
+    uint8_t bytes[5] = { 0x9A, 0x5C, 0x31, 0xE7, 0x80 };
+
+    send_pwm(bytes, 37, 3);
+}
+
+static int check_radio(void)
+{
+    static const unsigned ppmPulse[2] = { PPM_TIME_PULSE, PPM_TIME_PULSE };
+    static const unsigned ppmGaps[2] = { PPM_TIME_OFF_0, PPM_TIME_OFF_1 };
+    static const unsigned nexusPulse[2] = { NEXUS_TIME_PULSE, NEXUS_TIME_PULSE };
+    static const unsigned nexusGaps[2] = { NEXUS_TIME_OFF_0, NEXUS_TIME_OFF_1 };
+    static const unsigned pwmTimes[2] = { PWM_TIME_SHORT, PWM_TIME_LONG };
+    int failures = 0;
+
+    failures += check_radio_train("prologue", send_prologue, ppmPulse, ppmGaps, PPM_TIME_OFF_1 + 1000);
+    failures += check_radio_train("nexus", send_nexus, nexusPulse, nexusGaps, NEXUS_TIME_OFF_1 + 500);
+    failures += check_radio_train("pwm", send_pwm37, pwmTimes, pwmTimes, PWM_TIME_LONG + 1000);
+
+    // The frame must still decode from the simulated pulse train
+    static ook_pulses pulses;
+    uint64_t frame;
+    gateway_readings readings;
+
+    sim_reset();
+    ook_capture_start(&pulses);
+    prologue_send(0x5A, 3, -405, 55, 1, 1);
+    ook_capture_stop();
+
+    if (!gateway_readings_alloc(&readings, 1) || !gateway_capture_frame(&pulses, kGatewayPrologue, &frame)) {
+        printf("FAIL radio frame not decoded\n");
+        failures++;
+    } else {
+        gateway_decode_prologue(&frame, 1, &readings);
+
+        if (readings.temperature[0] != -405 || readings.id[0] != 0x5A) {
+            printf("FAIL radio frame decoded as id %02x, %d\n", readings.id[0], readings.temperature[0]);
+            failures++;
+        }
+    }
+
+    gateway_readings_free(&readings);
+
+    return failures;
+}
+
+static int check_usart(void)
+{
+    double baud = F_CPU / (8.0 * (MYUBRR + 1));
+    double error = (baud - BAUD) / BAUD;
+
+    printf("usart     %.0f baud, %+.1f%%\n", baud, error * 100);
+
+    // Both ends may be off, 2% each is the usual budget
+    if (fabs(error) > 0.02) {
+        printf("FAIL usart baud rate\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Search and read simulated sensors through the fixed pin build of onewire.c
+ */
+static int check_bus(void)
+{
+    static const uint8_t serial[3][6] = {
+        { 0x61, 0x64, 0x12, 0x3C, 0x7A, 0x05 },
+        { 0xFF, 0x02, 0x34, 0x56, 0x78, 0x9A },
+        { 0x3E, 0x8B, 0x41, 0x02, 0x08, 0x00 },
+    };
+    static const uint8_t family[3] = { 0x28, 0x28, 0x10 };
+    static const int16_t temperature[3] = { 21 * 16 + 8, -10 * 16 - 2, 23 * 16 + 4 };
+    const gpin_t pin = { &PORTC, &PINC, &DDRC, PC2 };
+    onewire_search_state search;
+    unsigned found = 0;
+    int failures = 0;
+
+    sim_reset();
+    ow_bus_init(&pin);
+
+    for (unsigned i = 0; i < 3; ++i) {
+        ow_bus_add(family[i], serial[i], temperature[i]);
+    }
+
+    ds18b20_convert(&pin);
+    _delay_ms(750);
+
+    onewire_search_init(&search);
+
+    while (onewire_search(&pin, &search)) {
+        int16_t reading = ds18b20_read_slave(&pin, search.address);
+
+        for (unsigned i = 0; i < 3; ++i) {
+            if (search.address[1] == serial[i][0] && reading != temperature[i]) {
+                printf("FAIL bus reading of %02x..%02x: %04x\n", search.address[0], search.address[7], (uint16_t) reading);
+                failures++;
+            }
+        }
+
+        found++;
+    }
+
+    if (found != 3) {
+        printf("FAIL bus search found %u devices\n", found);
+        failures++;
+    }
+
+    return failures;
+}
+
+int main(void)
+{
+    slot_timings t;
+    int failures = 0;
+
+    printf("%lu MHz    times in us from the falling edge: reset low/presence sample, "
+        "write low/slot, read low/sample/slot\n", F_CPU / 1000000UL);
+
+    if (measure_slots(&t)) {
+        failures += check_slots("fixed pin", &t, false);
+    } else {
+        failures++;
+    }
+
+    model_uart(&t);
+    failures += check_slots("usart", &t, true);
+
+    failures += check_usart();
+    failures += check_radio();
+    failures += check_bus();
+
+    printf("timing at %lu MHz: %s\n\n", F_CPU / 1000000UL, failures ? "FAIL" : "ok");
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+// Host build replacement for <util/atomic.h>
+// Clearing the interrupt flag holds back the interrupts injected by the
+// simulator until it is restored (see sim_irq_inject() in sim.h)
+
+#include <avr/io.h>
+
+uint8_t sim_irq_disable(void);
+void sim_irq_restore(const uint8_t* sreg);
+void sim_irq_enable(const uint8_t* sreg);
+
+#define ATOMIC_RESTORESTATE uint8_t sim_sreg_save __attribute__((__cleanup__(sim_irq_restore))) = SREG
+#define ATOMIC_FORCEON uint8_t sim_sreg_save __attribute__((__cleanup__(sim_irq_enable))) = 0
+
+#define ATOMIC_BLOCK(type) for (type, sim_todo = sim_irq_disable(); sim_todo; sim_todo = 0)
@@ -0,0 +1,20 @@
+#pragma once
+
+// Host build replacement for <util/crc16.h>
+
+#include <stdint.h>
+
+static inline uint8_t _crc_ibutton_update(uint8_t crc, uint8_t data)
+{
+    crc = crc ^ data;
+
+    for (uint8_t i = 0; i < 8; i++) {
+        if (crc & 0x01) {
+            crc = (crc >> 1) ^ 0x8C;
+        } else {
+            crc >>= 1;
+        }
+    }
+
+    return crc;
+}
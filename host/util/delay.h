@@ -0,0 +1,15 @@
+#pragma once
+
+// Host build replacement for <util/delay.h>
+// Delays advance the simulated clock instead of busy waiting (see sim.c)
+
+// C
+#include <stdint.h>
+
+void _delay_us(double us);
+void _delay_ms(double ms);
+
+void sim_advance_cycles(uint64_t cycles);
+
+// avr-gcc builtin, the cycle count must be a compile time constant there
+#define __builtin_avr_delay_cycles(cycles) sim_advance_cycles(cycles)
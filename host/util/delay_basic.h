@@ -0,0 +1,8 @@
+#pragma once
+
+// Host build replacement for <util/delay_basic.h>
+
+#include <stdint.h>
+
+void _delay_loop_1(uint8_t count);
+void _delay_loop_2(uint16_t count);
@@ -0,0 +1,216 @@
+#include "vcd.h"
+#include "sim.h"
+
+// C
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define VCD_MAX_SIGNALS 16
+#define VCD_MAX_TEXT 48
+
+typedef struct vcd_signal {
+    char name[32];
+    bool text;
+} vcd_signal;
+
+typedef struct vcd_event {
+    uint64_t time;
+    uint32_t sequence;
+    uint8_t signal;
+    uint8_t value;
+    char text[VCD_MAX_TEXT];
+} vcd_event;
+
+typedef struct vcd_pin {
+    volatile uint8_t* reg;
+    uint8_t bit;
+    uint8_t signal;
+    int8_t last;
+} vcd_pin;
+
+static FILE* file;
+static vcd_signal signals[VCD_MAX_SIGNALS];
+static uint8_t signalCount;
+
+static vcd_event* events;
+static uint32_t eventCount;
+static uint32_t eventCapacity;
+
+static vcd_pin pins[VCD_MAX_SIGNALS];
+static uint8_t pinCount;
+
+int vcd_open(const char* path)
+{
+    file = fopen(path, "w");
+
+    if (file == NULL) {
+        return -1;
+    }
+
+    signalCount = 0;
+    eventCount = 0;
+    pinCount = 0;
+
+    return 0;
+}
+
+static uint8_t declare(const char* name, bool text)
+{
+    if (signalCount == VCD_MAX_SIGNALS) {
+        return VCD_MAX_SIGNALS - 1;
+    }
+
+    vcd_signal* s = &signals[signalCount];
+    snprintf(s->name, sizeof(s->name), "%s", name);
+    s->text = text;
+
+    return signalCount++;
+}
+
+uint8_t vcd_wire(const char* name)
+{
+    return declare(name, false);
+}
+
+uint8_t vcd_string(const char* name)
+{
+    return declare(name, true);
+}
+
+static vcd_event* add_event(uint8_t signal, uint64_t time_ns)
+{
+    if (file == NULL) {
+        return NULL;
+    }
+
+    if (eventCount == eventCapacity) {
+        eventCapacity = eventCapacity ? eventCapacity * 2 : 4096;
+        events = realloc(events, eventCapacity * sizeof(vcd_event));
+    }
+
+    vcd_event* e = &events[eventCount];
+    e->time = time_ns;
+    e->sequence = eventCount++;
+    e->signal = signal;
+    e->value = 0;
+    e->text[0] = '\0';
+
+    return e;
+}
+
+void vcd_change(uint8_t signal, uint64_t time_ns, uint8_t value)
+{
+    vcd_event* e = add_event(signal, time_ns);
+
+    if (e != NULL) {
+        e->value = value != 0;
+    }
+}
+
+void vcd_text(uint8_t signal, uint64_t time_ns, const char* text)
+{
+    vcd_event* e = add_event(signal, time_ns);
+
+    if (e == NULL) {
+        return;
+    }
+
+    // Values can not contain whitespace
+    snprintf(e->text, sizeof(e->text), "%s", text);
+
+    for (char* c = e->text; *c; ++c) {
+        if (*c == ' ') {
+            *c = '_';
+        }
+    }
+}
+
+static void vcd_pin_watch(uint64_t from_ns, uint64_t to_ns)
+{
+    (void) to_ns;
+
+    for (uint8_t i = 0; i < pinCount; ++i) {
+        int8_t level = (*pins[i].reg >> pins[i].bit) & 0x1;
+
+        if (level != pins[i].last) {
+            vcd_change(pins[i].signal, from_ns, level);
+            pins[i].last = level;
+        }
+    }
+}
+
+void vcd_watch_pin(const char* name, volatile uint8_t* reg, uint8_t bit)
+{
+    if (pinCount == VCD_MAX_SIGNALS) {
+        return;
+    }
+
+    pins[pinCount].reg = reg;
+    pins[pinCount].bit = bit;
+    pins[pinCount].signal = vcd_wire(name);
+    pins[pinCount].last = -1;
+    pinCount++;
+
+    sim_watch(vcd_pin_watch);
+}
+
+static int compare_events(const void* a, const void* b)
+{
+    const vcd_event* ea = a;
+    const vcd_event* eb = b;
+
+    if (ea->time != eb->time) {
+        return ea->time < eb->time ? -1 : 1;
+    }
+
+    return ea->sequence < eb->sequence ? -1 : 1;
+}
+
+void vcd_close(void)
+{
+    if (file == NULL) {
+        return;
+    }
+
+    fprintf(file, "$version ds1820_avr_radio host simulation $end\n");
+    fprintf(file, "$timescale 1ns $end\n");
+    fprintf(file, "$scope module avr $end\n");
+
+    // Identifiers are single printable characters starting at '!'
+    for (uint8_t i = 0; i < signalCount; ++i) {
+        fprintf(file, "$var %s 1 %c %s $end\n",
+            signals[i].text ? "string" : "wire", '!' + i, signals[i].name);
+    }
+
+    fprintf(file, "$upscope $end\n");
+    fprintf(file, "$enddefinitions $end\n");
+
+    qsort(events, eventCount, sizeof(vcd_event), compare_events);
+
+    uint64_t time = UINT64_MAX;
+
+    for (uint32_t i = 0; i < eventCount; ++i) {
+        const vcd_event* e = &events[i];
+
+        if (e->time != time) {
+            time = e->time;
+            fprintf(file, "#%llu\n", (unsigned long long) time);
+        }
+
+        if (signals[e->signal].text) {
+            fprintf(file, "s%s %c\n", e->text, '!' + e->signal);
+        } else {
+            fprintf(file, "%u%c\n", e->value, '!' + e->signal);
+        }
+    }
+
+    fclose(file);
+    file = NULL;
+
+    free(events);
+    events = NULL;
+    eventCount = 0;
+    eventCapacity = 0;
+}
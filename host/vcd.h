@@ -0,0 +1,44 @@
+#pragma once
+
+// Value Change Dump output of the host simulation, for viewing in GTKWave
+//
+// Changes may be reported out of order (annotations are only known once a
+// whole byte has been seen); they are sorted by time when the file is closed.
+
+// C
+#include <stdint.h>
+
+/**
+ * Start a new dump, returns 0 on success
+ * The file is only written by vcd_close().
+ */
+int vcd_open(const char* path);
+
+/**
+ * Write and close the dump
+ */
+void vcd_close(void);
+
+/**
+ * Declare a 1-bit signal, returns its handle
+ * Signals must be declared before the first change.
+ */
+uint8_t vcd_wire(const char* name);
+
+/**
+ * Declare a text signal (GTKWave string extension), returns its handle
+ */
+uint8_t vcd_string(const char* name);
+
+/**
+ * Record a change of a wire or a text signal at time_ns
+ * Both calls do nothing if no dump is open.
+ */
+void vcd_change(uint8_t signal, uint64_t time_ns, uint8_t value);
+void vcd_text(uint8_t signal, uint64_t time_ns, const char* text);
+
+/**
+ * Dump a bit of an I/O register (eg. PORTC) as a wire
+ * The register is sampled on every step of the simulated clock.
+ */
+void vcd_watch_pin(const char* name, volatile uint8_t* reg, uint8_t bit);
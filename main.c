@@ -4,7 +4,7 @@
 #define PIN_LED 1
 
 #define BIT_SET(a, b) a |= 1 << b
-#define BIT_CLEAR(a, b) a &= !(1 << b)
+#define BIT_CLEAR(a, b) a &= ~(1 << b)
 
 #define RADIO_ON BIT_SET(PORT, PIN_RADIO)
 #define RADIO_OFF BIT_CLEAR(PORT, PIN_RADIO)
@@ -12,9 +12,6 @@
 #define LED_ON BIT_SET(PORT, PIN_LED)
 #define LED_OFF BIT_CLEAR(PORT, PIN_LED)
 
-#define RADIO_ON BIT_SET(PORT, PIN_RADIO)
-#define RADIO_OFF BIT_CLEAR(PORT, PIN_RADIO)
-
 #include <avr/io.h>
 #include <util/delay.h>
 
@@ -23,15 +20,141 @@
 #include "ds18b20.h"
 #include "usart.h"
 #include "radio.h"
+#include "trace.h"
+#include "samples.h"
+#include "stats.h"
+#include "sensors.h"
+
+// scratch pad read mode of newly found sensors, kDS18B20_ReadFastPlausible
+// saves about 4 ms of bus time per sensor on short buses, see ds18b20.h;
+// the 'm' serial command changes it at run time
+#ifndef SENSOR_READ_MODE
+#define SENSOR_READ_MODE kDS18B20_ReadFull
+#endif
+
+// number of times a failed scratch pad read is repeated
+#define SENSOR_READ_RETRIES 2
+
+/**
+ * Radio device id and channel of a sensor, valid for the emulated thermometer
+ * type, from a 2 byte hash of its ROM code
+ * @returns the hash
+ */
+static uint16_t radio_hash(const uint8_t* address, uint8_t* id, uint8_t* channel)
+{
+	uint16_t hash = (address[0] << 8 | address[1]) ^
+		(address[2] << 8 | address[3]) ^
+		(address[4] << 8 | address[5]) ^
+		(address[6] << 8 | address[7]);
+	
+	*id = (hash >> 4) & 0x0F;
+	*channel = hash & 0x03;
+	
+	return hash;
+}
+
+#ifndef SAMPLES_FRAMES
+/**
+ * Send a buffered measurement as a Prologue frame, which rtl_433 and
+ * Domoticz decode. Samples recovered from the EEPROM belong to the handles
+ * of the previous run, the search finds the same devices in the same order.
+ */
+static void send_prologue(const sample_t* sample)
+{
+	uint8_t address[8];
+	uint8_t id, channel;
+	
+	if (sample->sensor >= sensors_count())
+	{
+		return;
+	}
+	
+	sensors_rom(sample->sensor, address);
+	radio_hash(address, &id, &channel);
+	
+	// void prologue_send(uint8_t id, uint8_t channel, int16_t temperature, uint8_t humidity, uint8_t battery_status, uint8_t button_pressed)
+	prologue_send(id, channel, (sample->temperature * 10) / 16, 11, 1, 0);
+	
+	// the frame ends with a short gap, keep the next one apart like a repeat
+	_delay_us(PPM_TIME_SYNC);
+}
+#endif
+
+/**
+ * 'm' serial command: "m<mode>" sets the scratch pad read mode of all known
+ * sensors, "m<mode> <handle>" of one, ended by a new line. Modes are the
+ * kDS18B20_Read* values, 0 full and 1 fast.
+ */
+static void read_mode_command(void)
+{
+	char s[30];
+	uint8_t mode = USART_Receive() - '0';
+	uint8_t c = USART_Receive();
+	uint16_t handle = 0;
+	bool all = (c != ' ');
+	
+	if (!all)
+	{
+		while ((c = USART_Receive()) >= '0' && c <= '9')
+		{
+			handle = handle * 10 + (c - '0');
+		}
+	}
+	
+	if (mode > kDS18B20_ReadFastPlausible || (!all && handle >= sensors_count()))
+	{
+		USART_TransmitString("mode: invalid\r\n");
+		return;
+	}
+	
+	for (sensor_t i = 0; i < sensors_count(); i++)
+	{
+		if (all || i == handle)
+		{
+			sensors_set_read_mode(i, mode);
+		}
+	}
+	
+	if (all)
+	{
+		sprintf(s, "mode: %u for all\r\n", mode);
+	}
+	else
+	{
+		sprintf(s, "mode: %u for %u\r\n", mode, handle);
+	}
+	
+	USART_TransmitString(s);
+}
+
+static unsigned char reading_failed(int16_t reading)
+{
+	return reading == (int16_t) kDS18B20_CrcCheckFailed ||
+		reading == (int16_t) kDS18B20_ValidationFailed ||
+		reading == (int16_t) kDS18B20_DeviceNotFound;
+}
 
 int main()
 {
 	char s[50];
-	unsigned int i;
+	sensor_t i;
+	uint8_t address[8];
 	uint16_t a1;
 	uint8_t a2, a3;
 	
+	// seconds since start, counted from the delays of the main loop
+	uint16_t now = 0;
+	
+#ifdef STATS_RADIO
+	uint16_t lastHealth = 0;
+#endif
+	
+	// radio transmissions, switched with the 'r' command; while they are
+	// off the measurements stay buffered (and spill into the EEPROM)
+	bool radioOn = true;
+	
 	onewire_search_state search;
+	sample_t sample;
 	
 	DDR = 0x00;
 	DDR |= 1 << PIN_RADIO;
@@ -41,11 +164,50 @@ int main()
 	
 	USART_TransmitString("Hello!\r\n");
 	
+	trace_init();
+	samples_init();
+	sensors_init();
+	
 	// pin definition format needed by the ds18b20 library
 	const gpin_t sensorPin = { &PORTC, &PINC, &DDRC, PC2 };
 	
 	while (1)
 	{
+		// serial commands
+		if (USART_DataAvailable())
+		{
+			switch (USART_Receive())
+			{
+				// send the timing trace (TRACE builds only)
+				case 't':
+					trace_dump();
+					trace_clear();
+					break;
+				
+				// send the buffered measurements
+				case 'd':
+					samples_dump();
+					break;
+				
+				// send the bus health counters and the sensor registry
+				case 's':
+					stats_dump();
+					sensors_dump();
+					break;
+				
+				// switch the radio off or back on
+				case 'r':
+					radioOn = !radioOn;
+					USART_TransmitString(radioOn ? "radio: on\r\n" : "radio: off\r\n");
+					break;
+				
+				// scratch pad read mode of the sensors
+				case 'm':
+					read_mode_command();
+					break;
+			}
+		}
+		
 		LED_ON;
 		_delay_ms(50);
 		LED_OFF;
@@ -58,41 +220,124 @@ int main()
 			_delay_ms(50);
 			LED_OFF;
 			
-			onewire_search_init(&search);
+			// parasite powered sensors need a strong pull-up to convert together
+			uint8_t strategy = ds18b20_strategy(&sensorPin);
+			
+			// time of the conversion the readings come from: a conversion of
+			// all devices is read out sensor by sensor, 20s apart
+			uint16_t converted = now;
+			
+			// start the temperature conversion on all devices and wait for it to finish
+			if (strategy != kDS18B20_ConvertSequential)
+			{
+				ds18b20_convert_wait(&sensorPin, NULL, strategy);
+				now += 1;
+				converted = now;
+			}
 			
-			i = 0;
+			onewire_search_init(&search);
+			sensors_begin_scan();
 			
-			// loop through all devices
+			// register all devices, known ones keep their handle
 			while (onewire_search(&sensorPin, &search))
 			{
 				if (!onewire_check_rom_crc(&search))
 				{
-					USART_TransmitString("check_rom: crc error");
+					USART_TransmitString("check_rom: crc error\r\n");
 					continue;
 				}
 				
-				// read the temperature
-				ds18b20_convert_slave(&sensorPin, search.address);
+				uint8_t known = sensors_count();
+				
+				i = sensors_add(search.address);
 				
-				// wait for conversion to finish
-				_delay_ms(750);
+				if (i == SENSORS_NONE)
+				{
+					USART_TransmitString("sensors: full or unknown family\r\n");
+					continue;
+				}
 				
-				// read the temperature from device
-				int16_t reading = ds18b20_read_slave(&sensorPin, search.address);
+				if (sensors_count() != known)
+				{
+					sensors_set_read_mode(i, SENSOR_READ_MODE);
+					sensors_set_status(i, SENSOR_PARASITE, ds18b20_parasite(&sensorPin, search.address));
+					
+					// the handle is the sensor of the samples and batch frames
+					sprintf(s, "sensors: %u = %02x%02x%02x%02x%02x%02x%02x%02x\r\n", i,
+						search.address[0], search.address[1], search.address[2], search.address[3],
+						search.address[4], search.address[5], search.address[6], search.address[7]);
+					USART_TransmitString(s);
+				}
+			}
+			
+			// loop through all devices found by the search
+			for (i = 0; i < sensors_count(); i++)
+			{
+				if (!(sensors_status(i) & SENSOR_PRESENT))
+				{
+					continue;
+				}
+				
+				sensors_rom(i, address);
+				
+				trace_bus_time_clear();
+				
+				// without a strong pull-up each parasite sensor converts on its own
+				if (strategy == kDS18B20_ConvertSequential)
+				{
+					ds18b20_convert_wait(&sensorPin, address, strategy);
+					now += 1;
+					converted = now;
+				}
 				
-				// create a 2 byte hash from the device's address - used for radio device id
-				a1 = (search.address[0] << 8 | search.address[1]) ^
-					(search.address[2] << 8 | search.address[3]) ^
-					(search.address[4] << 8 | search.address[5]) ^
-					(search.address[6] << 8 | search.address[7]);
+				// read the temperature from device, repeating failed reads
+				int16_t reading;
+				stats_sensor_t* sensorStats = sensors_stats(i);
 				
-				// calculate a radio device id and channel
-				// that are valid for the emulated thermometer type
-				a2 = (a1 >> 4) & 0x0F;
-				a3 = a1 & 0x03;
+				// full reads update the resolution, fast reads decode with it
+				uint8_t resolution = sensors_resolution(i);
+				
+				for (uint8_t attempt = 0; ; attempt++)
+				{
+					reading = ds18b20_read_slave_mode(&sensorPin, address, sensors_read_mode(i), &resolution);
+					
+					STATS_INC(sensorStats->reads);
+					
+					if (reading == kDS18B20_CrcCheckFailed)
+					{
+						STATS_INC(sensorStats->crcFailures);
+					}
+					else if (reading_failed(reading))
+					{
+						STATS_INC(sensorStats->invalid);
+					}
+					
+					if (!reading_failed(reading) || attempt == SENSOR_READ_RETRIES)
+					{
+						break;
+					}
+					
+					STATS_INC(stats_bus.retries);
+					STATS_INC(sensorStats->retries);
+				}
+				
+				sensors_set_status(i, SENSOR_CRC_ERROR, reading == kDS18B20_CrcCheckFailed);
+				sensors_set_resolution(i, resolution);
+				
+				if (reading_failed(reading))
+				{
+					sensors_set_status(i, SENSOR_VALID, false);
+				}
+				else
+				{
+					sensors_set_reading(i, reading, converted);
+				}
+				
+				// radio device id and channel of the Prologue frames
+				a1 = radio_hash(address, &a2, &a3);
 				
 				// send the device index, generated device id and channel, address on serial
-				sprintf(s, "%d %04x %02x %02x %02x%02x%02x%02x%02x%02x%02x%02x: ", i, a1, a2, a3, search.address[0], search.address[1], search.address[2], search.address[3], search.address[4], search.address[5], search.address[6], search.address[7]);
+				sprintf(s, "%d %04x %02x %02x %02x%02x%02x%02x%02x%02x%02x%02x: ", i, a1, a2, a3, address[0], address[1], address[2], address[3], address[4], address[5], address[6], address[7]);
 				USART_TransmitString(s);
 				
 				// if reading failed skip this device
@@ -102,25 +347,67 @@ int main()
 					continue;
 				}
 				
+				if (reading == (int16_t) kDS18B20_ValidationFailed || reading == (int16_t) kDS18B20_DeviceNotFound)
+				{
+					USART_TransmitString("read_slave: invalid reading\r\n");
+					continue;
+				}
+				
 				// Convert to floating point (or keep as a Q12.4 fixed point value)
 				float temperature = ((float) reading) / 16;
 				
 				sprintf(s, "%d %04x", (int) (temperature * 10), reading);
 				USART_TransmitString(s);
 				
-				// void prologue_send(uint8_t id, uint8_t channel, float temperature, uint8_t humidity, uint8_t battery_status, uint8_t button_pressed)
-				prologue_send(a2, a3, temperature, 11, 1, 0);
+#ifdef TRACE
+				// bus time spent on this sensor
+				sprintf(s, " %luus", (unsigned long) trace_bus_time());
+				USART_TransmitString(s);
+#endif
+				
+				// store the measurement, it is sent with the next batch
+				sample.time = converted;
+				sample.sensor = i;
+				sample.temperature = reading;
+				samples_push(&sample);
+				
+#ifndef SAMPLES_FRAMES
+				// send it right away, with the ones held back while the radio was off
+				if (radioOn)
+				{
+					while (samples_next(&sample))
+					{
+						send_prologue(&sample);
+					}
+				}
+#endif
 				
 				// wait before going to the next device
 				_delay_ms(20000);
+				now += 20;
 				
 				USART_TransmitString("\r\n");
-				
-				i++;
 			}
 			
 			USART_TransmitString("\r\n");
 		}
+		
+#ifdef SAMPLES_FRAMES
+		// send all waiting measurements in one burst, two per frame
+		if (radioOn && samples_batch_due(now))
+		{
+			samples_send(now);
+		}
+#endif
+		
+#ifdef STATS_RADIO
+		// bus health report
+		if (radioOn && (uint16_t) (now - lastHealth) >= STATS_RADIO_INTERVAL)
+		{
+			stats_send();
+			lastHealth = now;
+		}
+#endif
 	}
 	
 	return 0;
@@ -1,71 +1,147 @@
 #include "onewire.h"
+#include "onewire_timing.h"
 #include "crc.h"
+#include "stats.h"
+#include "trace.h"
 
+#include <util/atomic.h>
 #include <util/delay.h>
 
+// External definitions of the inline functions in onewire.h, for calls the
+// compiler decides not to inline
+extern void onewire_search_init(onewire_search_state* state);
+extern void onewire_search_family_init(onewire_search_state* state, uint8_t family);
+
+// Bus primitives: onewire_reset, onewire_write_bit, onewire_write,
+// onewire_read_bit and onewire_read. With ONEWIRE_UART defined they are
+// provided by onewire_uart.c instead.
+//
+// Delays are counted in CPU cycles, including the pin accesses between two
+// edges (see onewire_timing.h). Interrupts are only disabled in the windows
+// where a delay changes what the devices see:
+//
+//  - reset: from the release of the line to the presence sample (70uS), a
+//    presence pulse may be over 75uS after the release
+//  - write 1: the 5uS low pulse, devices sample the line 15uS into the slot
+//  - read: from the low pulse to the sample (12uS), which must be taken
+//    within 15uS
+//
+// This is the worst case latency added to an interrupt: 70uS during a
+// reset, 12uS otherwise. Anywhere else an interrupt only stretches the bus
+// timing in a harmless direction: the reset pulse and the recovery time
+// between slots have no upper limit, and the low part of a write 0
+// (ONEWIRE_WRITE0_LOW_US, 62uS) can take 58uS longer before reaching the
+// 120uS limit, which is the latency budget for interrupt handlers.
+#ifndef ONEWIRE_UART
+
+#ifdef ONEWIRE_PORT
+
+// The PORT bit stays clear, the line is pulled low by switching the pin to
+// an output and released by switching it back to an input
+#define BUS_PREPARE(io) (ONEWIRE_PORT &= ~_BV(ONEWIRE_BIT))
+#define BUS_PREPARE_READ(io) BUS_PREPARE(io)
+#define BUS_LOW(io) (ONEWIRE_DDR |= _BV(ONEWIRE_BIT))
+#define BUS_LOW_READ(io) BUS_LOW(io)
+#define BUS_RELEASE(io) (ONEWIRE_DDR &= ~_BV(ONEWIRE_BIT))
+#define BUS_HIZ(io) BUS_RELEASE(io)
+#define BUS_SAMPLE(io) (ONEWIRE_PIN & _BV(ONEWIRE_BIT))
+
+#else
+
+#if F_CPU < 8000000UL
+#error "gpin_t bus access is too slow below 8 MHz, build with ONEWIRE_FIXED_PIN=1"
+#endif
+
+// Every edge is a single gset_* call: writes drive the line high between
+// slots, reads start from the released line
+#define BUS_PREPARE(io) do { gset_output_high(io); gset_output(io); } while (0)
+#define BUS_PREPARE_READ(io) gset_input_hiz(io)
+#define BUS_LOW(io) gset_output_low(io)
+#define BUS_LOW_READ(io) gset_output(io)
+#define BUS_RELEASE(io) gset_output_high(io)
+#define BUS_HIZ(io) gset_input_hiz(io)
+#define BUS_SAMPLE(io) gread_bit(io)
+
+#endif
+
 bool onewire_reset(const gpin_t* io)
 {
-    // Configure for output
-    gset_output_high(io);
-    gset_output(io);
+    TRACE_START(start);
 
     // Pull low for >480uS (master reset pulse)
-    gset_output_low(io);
-    _delay_us(480);
+    BUS_PREPARE(io);
+    BUS_LOW(io);
+    __builtin_avr_delay_cycles(ONEWIRE_RESET_LOW_DELAY);
+
+    uint8_t result = 1;
 
-    // Configure for input
-    gset_input_hiz(io);
-    _delay_us(70);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        // Configure for input
+        BUS_HIZ(io);
+        __builtin_avr_delay_cycles(ONEWIRE_PRESENCE_DELAY);
 
-    // Look for the line pulled low by a slave
-    uint8_t result = gread_bit(io);
+        // Look for the line pulled low by a slave
+        result = BUS_SAMPLE(io);
+    }
 
     // Wait for the presence pulse to finish
     // This should be less than 240uS, but the master is expected to stay
     // in Rx mode for a minimum of 480uS in total
-    _delay_us(460);
+    __builtin_avr_delay_cycles(ONEWIRE_RESET_END_DELAY);
+
+    TRACE_STOP(kTrace_OneWireReset, start);
+
+    STATS_INC(stats_bus.resets);
+
+    if (result != 0) {
+        STATS_INC(stats_bus.presenceFailures);
+    }
 
     return result == 0;
 }
 
-/**
- * Output a Write-0 or Write-1 slot on the One Wire bus
- * A Write-1 slot is generated unless the passed value is zero
- */
-static void onewire_write_bit(const gpin_t* io, uint8_t bit)
+void onewire_write_bit(const gpin_t* io, uint8_t bit)
 {
+    TRACE_START(start);
+
+    BUS_PREPARE(io);
+
     if (bit != 0) { // Write high
 
         // Pull low for less than 15uS to write a high
-        gset_output_low(io);
-        _delay_us(5);
-        gset_output_high(io);
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            BUS_LOW(io);
+            __builtin_avr_delay_cycles(ONEWIRE_WRITE1_LOW_DELAY);
+            BUS_RELEASE(io);
+        }
+
+        // Wait for the rest of the slot and the recovery time
+        __builtin_avr_delay_cycles(ONEWIRE_WRITE1_END_DELAY);
 
-        // Wait for the rest of the minimum slot time
-        _delay_us(55);
+        TRACE_STOP(kTrace_OneWireWrite1, start);
 
     } else { // Write low
 
         // Pull low for 60 - 120uS to write a low
-        gset_output_low(io);
-        _delay_us(55);
+        BUS_LOW(io);
+        __builtin_avr_delay_cycles(ONEWIRE_WRITE0_LOW_DELAY);
 
         // Stop pulling down line
-        gset_output_high(io);
+        BUS_RELEASE(io);
 
         // Recovery time between slots
-        _delay_us(5);
+        __builtin_avr_delay_cycles(ONEWIRE_WRITE0_END_DELAY);
+
+        TRACE_STOP(kTrace_OneWireWrite0, start);
     }
+
+    STATS_INC(stats_bus.slots);
 }
 
 // One Wire timing is based on this Maxim application note
 // https://www.maximintegrated.com/en/app-notes/index.mvp/id/126
 void onewire_write(const gpin_t* io, uint8_t byte)
 {
-    // Configure for output
-    gset_output_high(io);
-    gset_output(io);
-
     for (uint8_t i = 8; i != 0; --i) {
 
         onewire_write_bit(io, byte & 0x1);
@@ -75,27 +151,34 @@ void onewire_write(const gpin_t* io, uint8_t byte)
     }
 }
 
-/**
- * Generate a read slot on the One Wire bus and return the bit value
- * Return 0x0 or 0x1
- */
-static uint8_t onewire_read_bit(const gpin_t* io)
+uint8_t onewire_read_bit(const gpin_t* io)
 {
-    // Pull the 1-wire bus low for >1uS to generate a read slot
-    gset_output_low(io);
-    gset_output(io);
-    _delay_us(1);
+    TRACE_START(start);
+
+    uint8_t result = 0;
+
+    BUS_PREPARE_READ(io);
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        // Pull the 1-wire bus low for >1uS to generate a read slot
+        BUS_LOW_READ(io);
+        __builtin_avr_delay_cycles(ONEWIRE_READ_LOW_DELAY);
 
-    // Configure for reading (releases the line)
-    gset_input_hiz(io);
+        // Configure for reading (releases the line)
+        BUS_HIZ(io);
 
-    // Wait for value to stabilise (bit must be read within 15uS of read slot)
-    _delay_us(10);
+        // Wait for value to stabilise (bit must be read within 15uS of read slot)
+        __builtin_avr_delay_cycles(ONEWIRE_READ_SAMPLE_DELAY);
 
-    uint8_t result = gread_bit(io) != 0;
+        result = BUS_SAMPLE(io) != 0;
+    }
 
     // Wait for the end of the read slot
-    _delay_us(50);
+    __builtin_avr_delay_cycles(ONEWIRE_READ_END_DELAY);
+
+    TRACE_STOP(kTrace_OneWireRead, start);
+
+    STATS_INC(stats_bus.slots);
 
     return result;
 }
@@ -104,9 +187,6 @@ uint8_t onewire_read(const gpin_t* io)
 {
     uint8_t buffer = 0x0;
 
-    // Configure for input
-    gset_input_hiz(io);
-
     // Read 8 bits (LSB first)
     for (uint8_t bit = 0x01; bit; bit <<= 1) {
 
@@ -119,6 +199,8 @@ uint8_t onewire_read(const gpin_t* io)
     return buffer;
 }
 
+#endif
+
 void onewire_match_rom(const gpin_t* io, uint8_t* address)
 {
     // Write Match Rom command on bus
@@ -184,9 +266,6 @@ static bool _search_next(const gpin_t* io, onewire_search_state* state)
         uint8_t byteIndex = bitPosition / 8;
         uint8_t bitIndex = bitPosition % 8;
 
-        // Configure bus pin for reading
-        gset_input_hiz(io);
-
         // Read the current bit and its complement from the bus
         uint8_t reading = 0;
         reading |= onewire_read_bit(io); // Bit
@@ -209,7 +288,7 @@ static bool _search_next(const gpin_t* io, onewire_search_state* state)
 
                 } else if (bitPosition < state->lastZeroBranch) {
                     // Before the lastZeroBranch position, repeat the same choices as the previous search
-                    bitValue = state->address[byteIndex] & (1 << bitIndex);
+                    bitValue = (state->address[byteIndex] >> bitIndex) & 0x1;
 
                 } else {
                     // Current bit is past the lastZeroBranch in the previous search: send zero
@@ -225,9 +304,17 @@ static bool _search_next(const gpin_t* io, onewire_search_state* state)
 
             default:
                 // If we see "11" there was a problem on the bus (no devices pulled it low)
+                STATS_INC(stats_bus.searchAborts);
                 return false;
         }
 
+        // Leaving the family code means there are no more devices of that family
+        if (state->filterFamily && bitPosition < 8 &&
+            (bitValue != 0) != ((state->family >> bitIndex) & 0x1)) {
+            state->done = true;
+            return false;
+        }
+
         // Write bit into address
         if (bitValue == 0) {
             state->address[byteIndex] &= ~(1 << bitIndex);
@@ -235,10 +322,6 @@ static bool _search_next(const gpin_t* io, onewire_search_state* state)
             state->address[byteIndex] |= (bitValue << bitIndex);
         }
 
-        // Configure for output
-        gset_output_high(io);
-        gset_output(io);
-
         // Write bit to the bus to continue the search
         onewire_write_bit(io, bitValue);
     }
@@ -283,8 +366,44 @@ bool onewire_alarm_search(const gpin_t* io, onewire_search_state* state)
     return _search_devices(0xEC, io, state);
 }
 
+bool onewire_verify_rom(const gpin_t* io, const uint8_t* address)
+{
+    if (!onewire_reset(io)) {
+        return false;
+    }
+
+    // Search with "Search ROM" command
+    onewire_write(io, 0xF0);
+
+    for (uint8_t bitPosition = 0; bitPosition < 64; ++bitPosition) {
+
+        uint8_t bitValue = (address[bitPosition / 8] >> (bitPosition % 8)) & 0x1;
+
+        // Read the current bit and its complement from the bus
+        uint8_t reading = 0;
+        reading |= onewire_read_bit(io); // Bit
+        reading |= onewire_read_bit(io) << 1; // Complement of bit (negated)
+
+        // A device with a one pulls the complement low, a device with a zero the bit.
+        // If the line for our value stayed high, the device is not there.
+        if (reading & (bitValue ? 0b10 : 0b01)) {
+            return false;
+        }
+
+        // Only keep devices matching the address in the search
+        onewire_write_bit(io, bitValue);
+    }
+
+    return true;
+}
+
 bool onewire_check_rom_crc(onewire_search_state* state)
 {
     // Validate bits 0..56 (bytes 0 - 6) against the CRC in byte 7 (bits 57..63)
-    return state->address[7] == crc8(state->address, 7);
+    if (state->address[7] != crc8(state->address, 7)) {
+        STATS_INC(stats_bus.romCrcFailures);
+        return false;
+    }
+
+    return true;
 }
\ No newline at end of file
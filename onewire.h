@@ -2,6 +2,10 @@
 
 #include "pindef.h"
 
+// The bus is driven in software through the gpin_t passed to every function.
+// Building with ONEWIRE_UART=1 ./build.sh selects the USART0 backend in
+// onewire_uart.c instead, which ignores the pin argument.
+
 // C
 #include <stdbool.h>
 #include <stdint.h>
@@ -20,6 +24,11 @@ typedef struct onewire_search_state {
     // This flag is set once there are no more branches to search
     bool done;
 
+    // Only report devices with this family code (first address byte)
+    // Set up by onewire_search_family_init()
+    bool filterFamily;
+    uint8_t family;
+
     // Discovered 64-bit device address (LSB first)
     // After a successful search, this contains the found device address.
     // During a search this is overwritten LSB-first with a new address.
@@ -44,6 +53,18 @@ void onewire_write(const gpin_t* io, uint8_t byte);
  */
 uint8_t onewire_read(const gpin_t* io);
 
+/**
+ * Output a Write-0 or Write-1 slot on the One Wire bus
+ * A Write-1 slot is generated unless the passed value is zero
+ */
+void onewire_write_bit(const gpin_t* io, uint8_t bit);
+
+/**
+ * Generate a read slot on the One Wire bus and return the bit value
+ * Return 0x0 or 0x1
+ */
+uint8_t onewire_read_bit(const gpin_t* io);
+
 /**
  * Skip sending a device address
  */
@@ -61,11 +82,30 @@ inline void onewire_search_init(onewire_search_state* state)
 {
     state->lastZeroBranch = -1;
     state->done = false;
+    state->filterFamily = false;
 
     // Zero-fill the address
     memset(state->address, 0, sizeof(state->address));
 }
 
+/**
+ * Reset a search state to only find devices of one family
+ *
+ * The first search goes straight to the lowest address with this family
+ * code: marking the last zero branch past the end of the address makes
+ * every ambiguous bit repeat the pre-seeded address. The search ends as
+ * soon as it would leave the family, without walking the rest of the tree.
+ */
+inline void onewire_search_family_init(onewire_search_state* state, uint8_t family)
+{
+    onewire_search_init(state);
+
+    state->lastZeroBranch = 64;
+    state->filterFamily = true;
+    state->family = family;
+    state->address[0] = family;
+}
+
 /**
  * Look for the next slave address on the bus
  *
@@ -85,6 +125,18 @@ bool onewire_search(const gpin_t* io, onewire_search_state* state);
  */
 bool onewire_alarm_search(const gpin_t* io, onewire_search_state* state);
 
+/**
+ * Check if the device with the given address (uint8_t[8]) is on the bus
+ *
+ * This walks the address through a Search ROM: after each bit and its
+ * complement are read, the bit of the address is written so only that device
+ * stays in the search. If no device answers with the expected bit, the walk
+ * stops right away. No other device is enumerated.
+ *
+ * @returns true if the device is present
+ */
+bool onewire_verify_rom(const gpin_t* io, const uint8_t* address);
+
 /**
  * Return true if the CRC byte in a ROM address validates
  */
@@ -0,0 +1,99 @@
+#pragma once
+
+// Cycle budget of the bit-banged bus in onewire.c
+//
+// Every delay between two edges of a slot is computed at compile time in CPU
+// cycles, minus the cycles of the pin accesses between the edges, so the
+// edges land on the targets below at any F_CPU instead of drifting by the
+// call overhead of the pin functions. A delay can't be negative: when the pin
+// accesses alone take longer than the target, the edge comes late, which is
+// what limits the lowest usable clock (checked by host/timing_test.c).
+//
+// The bus pin is reached in one of two ways:
+//
+//  - through the gpin_t passed to the functions (default). Each gset_* and
+//    gread_bit call costs about ONEWIRE_GPIN_CYCLES (call, loading the
+//    register pointer and the bit, read-modify-write, return), which only
+//    fits the read slot at 8 MHz and above.
+//  - on a pin fixed at compile time by ONEWIRE_PORT, ONEWIRE_PIN, ONEWIRE_DDR
+//    and ONEWIRE_BIT (ONEWIRE_FIXED_PIN=1 ./build.sh). Each access is a single
+//    sbi/cbi (2 cycles) or in (1 cycle), which works down to 1 MHz. The io
+//    parameter of the bus primitives is then ignored.
+//
+// Pin access costs are counted from the instructions avr-gcc -Os emits, an
+// edge happens at the end of the instruction that makes it.
+
+// Targets, Maxim application note 126 and the DS18B20 datasheet (uS). Hard
+// minimums get a little headroom, as the gpin_t costs are estimates.
+#define ONEWIRE_RESET_LOW_US 490     // >= 480
+#define ONEWIRE_PRESENCE_US 70       // 60 - 75 after the release
+#define ONEWIRE_RESET_END_US 460     // release >= 480 in total
+#define ONEWIRE_WRITE1_LOW_US 5      // 1 - 15
+#define ONEWIRE_WRITE0_LOW_US 62     // 60 - 120
+#define ONEWIRE_READ_LOW_US 1        // >= 1
+#define ONEWIRE_READ_SAMPLE_US 12    // < 15 after the falling edge
+#define ONEWIRE_SLOT_US 60           // >= 60 without the recovery
+#define ONEWIRE_RECOVERY_US 5        // >= 1
+
+// Cost of one gset_* or gread_bit call of pindef.c
+#define ONEWIRE_GPIN_CYCLES 20
+
+// Cost of sbi/cbi and of in on the fixed pin
+#define ONEWIRE_FIXED_SET_CYCLES 2
+#define ONEWIRE_FIXED_SAMPLE_CYCLES 1
+
+// Pin accesses between two edges: pulling the line low, releasing it after a
+// write, releasing it to read and sampling it
+#ifdef ONEWIRE_PORT
+
+#define ONEWIRE_LOW_CYCLES ONEWIRE_FIXED_SET_CYCLES        // sbi DDR
+#define ONEWIRE_RELEASE_CYCLES ONEWIRE_FIXED_SET_CYCLES    // cbi DDR
+#define ONEWIRE_HIZ_CYCLES ONEWIRE_FIXED_SET_CYCLES        // cbi DDR
+#define ONEWIRE_SAMPLE_CYCLES ONEWIRE_FIXED_SAMPLE_CYCLES  // in PIN
+
+#else
+
+#define ONEWIRE_LOW_CYCLES ONEWIRE_GPIN_CYCLES          // gset_output_low or gset_output
+#define ONEWIRE_RELEASE_CYCLES ONEWIRE_GPIN_CYCLES      // gset_output_high
+#define ONEWIRE_HIZ_CYCLES (2 * ONEWIRE_GPIN_CYCLES)    // gset_input_hiz calls gset_output_low
+#define ONEWIRE_SAMPLE_CYCLES ONEWIRE_GPIN_CYCLES       // gread_bit
+
+#endif
+
+/**
+ * Cycles in a number of microseconds at F_CPU, rounded to the nearest
+ */
+#define ONEWIRE_CYCLES(us) (((us) * (F_CPU / 1000UL) + 500UL) / 1000UL)
+
+/**
+ * Cycles to wait so that a delay followed by overhead cycles of pin accesses
+ * lasts us microseconds, 0 if the pin accesses take longer
+ */
+#define ONEWIRE_DELAY(us, overhead) \
+    (ONEWIRE_CYCLES(us) > (overhead) ? ONEWIRE_CYCLES(us) - (overhead) : 0)
+
+// Delays of the slots, in cycles. The end delays make the time from one
+// falling edge to the next at least a slot and a recovery time, the code
+// between two slots only adds to it.
+#define ONEWIRE_RESET_LOW_DELAY ONEWIRE_DELAY(ONEWIRE_RESET_LOW_US, ONEWIRE_HIZ_CYCLES)
+#define ONEWIRE_PRESENCE_DELAY ONEWIRE_DELAY(ONEWIRE_PRESENCE_US, ONEWIRE_SAMPLE_CYCLES)
+#define ONEWIRE_RESET_END_DELAY ONEWIRE_CYCLES(ONEWIRE_RESET_END_US)
+
+#define ONEWIRE_WRITE1_LOW_DELAY ONEWIRE_DELAY(ONEWIRE_WRITE1_LOW_US, ONEWIRE_RELEASE_CYCLES)
+#define ONEWIRE_WRITE1_END_DELAY ONEWIRE_DELAY(ONEWIRE_SLOT_US + ONEWIRE_RECOVERY_US, \
+    ONEWIRE_WRITE1_LOW_DELAY + ONEWIRE_RELEASE_CYCLES + ONEWIRE_LOW_CYCLES)
+
+#define ONEWIRE_WRITE0_LOW_DELAY ONEWIRE_DELAY(ONEWIRE_WRITE0_LOW_US, ONEWIRE_RELEASE_CYCLES)
+#define ONEWIRE_WRITE0_END_DELAY ONEWIRE_CYCLES(ONEWIRE_RECOVERY_US)
+
+#define ONEWIRE_READ_LOW_DELAY ONEWIRE_DELAY(ONEWIRE_READ_LOW_US, ONEWIRE_HIZ_CYCLES)
+#define ONEWIRE_READ_SAMPLE_DELAY ONEWIRE_DELAY(ONEWIRE_READ_SAMPLE_US, \
+    ONEWIRE_READ_LOW_DELAY + ONEWIRE_HIZ_CYCLES + ONEWIRE_SAMPLE_CYCLES)
+#define ONEWIRE_READ_END_DELAY ONEWIRE_DELAY(ONEWIRE_SLOT_US + ONEWIRE_RECOVERY_US, \
+    ONEWIRE_READ_LOW_DELAY + ONEWIRE_HIZ_CYCLES + ONEWIRE_READ_SAMPLE_DELAY + \
+    ONEWIRE_SAMPLE_CYCLES + ONEWIRE_LOW_CYCLES)
+
+/**
+ * Register value of the USART in double speed mode, rounded to the nearest rate
+ */
+#define ONEWIRE_UBRR(baud) ((F_CPU + 4UL * (baud)) / (8UL * (baud)) - 1)
@@ -0,0 +1,139 @@
+#include "onewire.h"
+#include "onewire_timing.h"
+#include "stats.h"
+
+#ifdef ONEWIRE_UART
+
+// AVR
+#include <avr/io.h>
+
+// USART0 backend for the One Wire bus
+//
+// TXD drives the bus through an open drain buffer (or a diode, cathode to
+// TXD) and RXD reads it back, with the usual pull-up resistor on the bus.
+// Every UART frame then becomes a bus slot: the start bit is the low pulse
+// and the data bits decide how long it lasts.
+//
+//  - Reset: 0xF0 at 9600 baud holds the bus low for 5 bits (520uS). A
+//    presence pulse corrupts the high part, so anything but 0xF0 comes back,
+//    except 0x00: the bus did not come back up, it is shorted to ground.
+//  - Write-1 and read slots: 0xFF at 115200 baud, only the start bit is low
+//    (<10uS). If a slave holds the bus low, less than 0xFF comes back.
+//  - Write-0 slots: 0x00 at 115200 baud, low for 9 bits (78uS).
+//
+// The io parameter of all functions is ignored.
+//
+// See Maxim application note 214: Using a UART to Implement a 1-Wire Bus Master
+// https://www.maximintegrated.com/en/app-notes/index.mvp/id/214
+
+static void uart_setup(uint16_t ubrr)
+{
+    // Callers always wait for the previous frame to be read back,
+    // so the transmitter is idle here
+    UBRR0H = ubrr >> 8;
+    UBRR0L = ubrr;
+
+    // Double speed, 8 data bits, 1 stop bit, no parity
+    UCSR0A = _BV(U2X0);
+    UCSR0C = (3 << UCSZ00);
+    UCSR0B = _BV(RXEN0) | _BV(TXEN0);
+
+    // Drop anything left in the receive buffer
+    while (UCSR0A & _BV(RXC0)) {
+        (void) UDR0;
+    }
+}
+
+/**
+ * Send one frame and return what was read back from the bus
+ */
+static uint8_t uart_exchange(uint8_t data)
+{
+    UDR0 = data;
+
+    while (!(UCSR0A & _BV(RXC0)));
+
+    return UDR0;
+}
+
+/**
+ * Generate 8 slots for the bits of value (LSB first) and return the bits read back
+ *
+ * The transmitter is kept one frame ahead of the receiver, so the slots
+ * follow each other without gaps and the CPU only moves one byte per slot.
+ */
+static uint8_t uart_slots(uint8_t value)
+{
+    uint8_t sent = 0;
+    uint8_t result = 0;
+
+    for (uint8_t received = 0; received < 8; ) {
+
+        if (sent < 8 && (UCSR0A & _BV(UDRE0))) {
+            UDR0 = (value & (1 << sent)) ? 0xFF : 0x00;
+            sent++;
+        }
+
+        if (UCSR0A & _BV(RXC0)) {
+            // A 1 reads back as 0xFF, anything else means the bus was held low
+            if (UDR0 == 0xFF) {
+                result |= 1 << received;
+            }
+
+            received++;
+        }
+    }
+
+    return result;
+}
+
+bool onewire_reset(const gpin_t* io)
+{
+    (void) io;
+
+    uart_setup(ONEWIRE_UBRR(9600));
+    uint8_t result = uart_exchange(0xF0);
+    uart_setup(ONEWIRE_UBRR(115200));
+
+    STATS_INC(stats_bus.resets);
+
+    // No presence pulse, or no device can answer on a shorted bus
+    if (result == 0xF0 || result == 0x00) {
+        STATS_INC(stats_bus.presenceFailures);
+        return false;
+    }
+
+    return true;
+}
+
+void onewire_write_bit(const gpin_t* io, uint8_t bit)
+{
+    (void) io;
+    uart_exchange(bit ? 0xFF : 0x00);
+    STATS_INC(stats_bus.slots);
+}
+
+uint8_t onewire_read_bit(const gpin_t* io)
+{
+    (void) io;
+    STATS_INC(stats_bus.slots);
+    return uart_exchange(0xFF) == 0xFF;
+}
+
+void onewire_write(const gpin_t* io, uint8_t byte)
+{
+    (void) io;
+    uart_slots(byte);
+    stats_bus.slots += 8;
+}
+
+uint8_t onewire_read(const gpin_t* io)
+{
+    (void) io;
+    stats_bus.slots += 8;
+
+    // Read slots are Write-1 slots where the slave may hold the bus low
+    return uart_slots(0xFF);
+}
+
+#endif
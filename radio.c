@@ -1,82 +1,256 @@
 #include "radio.h"
 #include "defines.h"
+#include "trace.h"
 
-void send_ppm(uint8_t bytes[], uint8_t length, uint8_t repeats)
+#include <util/delay_basic.h>
+
+// PPM: every bit is a fixed pulse, the value is in the length of the gap
+// after it. A final pulse closes the last gap.
+#define PPM_PULSES { \
+		[kRadioSymbol0] = { RADIO_PULSE_US(PPM_TIME_PULSE), RADIO_GAP_US(PPM_TIME_OFF_0) }, \
+		[kRadioSymbol1] = { RADIO_PULSE_US(PPM_TIME_PULSE), RADIO_GAP_US(PPM_TIME_OFF_1) }, \
+		[kRadioTrailer] = { RADIO_PULSE_US(PPM_TIME_PULSE), RADIO_GAP_US(PPM_TIME_PULSE) }, \
+	}
+
+const radio_protocol_t radio_protocol_ppm PROGMEM = {
+	.pulses = PPM_PULSES,
+	.repeats = 1,
+	.repeat_gap = RADIO_GAP_US(PPM_TIME_SYNC),
+};
+
+// PWM: the value is in the length of the pulse, "1" is the short one. The
+// gap follows every repeat, the last one too, so that a frame sent right
+// after this one does not run into it.
+const radio_protocol_t radio_protocol_pwm PROGMEM = {
+	.pulses = {
+		[kRadioSymbol0] = { RADIO_PULSE_US(PWM_TIME_LONG), RADIO_GAP_US(PWM_TIME_SHORT) },
+		[kRadioSymbol1] = { RADIO_PULSE_US(PWM_TIME_SHORT), RADIO_GAP_US(PWM_TIME_LONG) },
+		[kRadioTrailer] = { 0, RADIO_GAP_US(PWM_TIME_GAP) },
+	},
+	.repeats = 3,
+};
+
+// Prologue: the PPM timings, sent 7 times
+const radio_protocol_t radio_protocol_prologue PROGMEM = {
+	.pulses = PPM_PULSES,
+	.repeats = 7,
+	.repeat_gap = RADIO_GAP_US(PPM_TIME_SYNC),
+};
+
+// Nexus and compatible sensors, PPM with a sync gap around every row: the
+// preamble opens the first row, the trailer closes the gap of the last bit
+// of each row and is the sync of the next one
+const radio_protocol_t radio_protocol_nexus PROGMEM = {
+	.pulses = {
+		[kRadioSymbol0] = { RADIO_PULSE_US(NEXUS_TIME_PULSE), RADIO_GAP_US(NEXUS_TIME_OFF_0) },
+		[kRadioSymbol1] = { RADIO_PULSE_US(NEXUS_TIME_PULSE), RADIO_GAP_US(NEXUS_TIME_OFF_1) },
+		[kRadioTrailer] = { RADIO_PULSE_US(NEXUS_TIME_PULSE), RADIO_GAP_US(NEXUS_TIME_SYNC) },
+		[kRadioPreamble] = { RADIO_PULSE_US(NEXUS_TIME_PULSE), RADIO_GAP_US(NEXUS_TIME_SYNC) },
+	},
+	.preamble_count = 1,
+	.repeats = 10,
+};
+
+static void radio_delay(uint16_t loops)
 {
-	uint8_t i, j, k, n;
+	// _delay_loop_2(0) would wait for 65536 iterations
+	if (loops != 0)
+	{
+		_delay_loop_2(loops);
+	}
+}
+
+#ifdef TRACE
+// Edges of one repeat, taken with a single TCNT1 read each. They are handed
+// to trace_record_period() once the frame is sent, as recording them as they
+// happen would stretch the pulses and gaps being measured.
+#define RADIO_TRACE_EDGES (2 * (RADIO_MAX_BITS + 2))
+
+static uint16_t traceEdges[RADIO_TRACE_EDGES];
+static uint8_t traceEdgeCount;
+
+#define RADIO_TRACE_EDGE() \
+	if (traceEdgeCount < RADIO_TRACE_EDGES) traceEdges[traceEdgeCount++] = TCNT1
+
+/**
+ * Record the pulses and data gaps of the repeat in traceEdges
+ */
+static void radio_trace_repeat(const radio_pulse_t pulses[], const uint8_t stream[], uint8_t n)
+{
+	uint8_t e = 0;
 	
-	for (k=0; k<repeats; k++)
+	for (uint8_t i = 0; i < n && e < traceEdgeCount; i++)
 	{
-		// sync pulse between the repeats
-		if (k != 0)
-		{
-			RADIO_OFF;
-			_delay_us(PPM_TIME_SYNC);
-		}
+		uint8_t symbol = stream[i];
 		
-		for (i=0; i<length; i++)
+		if (pulses[symbol].on != 0)
 		{
-			j = i % 8;
-			n = bytes[i / 8] & (1 << (7 - j));
-			
-			RADIO_ON;
-			_delay_us(PPM_TIME_PULSE);
-			
-			RADIO_OFF;
-			
-			if (n != 0)
+			if (e + 1 < traceEdgeCount)
 			{
-				_delay_us(PPM_TIME_OFF_1);
-			}
-			else
-			{
-				_delay_us(PPM_TIME_OFF_0);
+				trace_record_period(kTrace_RadioPulse, traceEdges[e], traceEdges[e + 1]);
 			}
+			
+			e++;
 		}
 		
-		// final bit
+		// Only data gaps have a PPM_TIME_* target. A gap ends with the next
+		// edge, the one of the last symbol is not kept.
+		if ((symbol == kRadioSymbol0 || symbol == kRadioSymbol1) && e + 1 < traceEdgeCount)
+		{
+			trace_record_period(kTrace_RadioGap0 + symbol, traceEdges[e], traceEdges[e + 1]);
+		}
+		
+		e++;
+	}
+}
+#else
+#define RADIO_TRACE_EDGE()
+#endif
+
+/**
+ * Output one on/off period of pulses[symbol]
+ * All pulses go through here, so every symbol gets the same overhead.
+ */
+static void radio_emit(const radio_pulse_t pulses[], uint8_t symbol)
+{
+	const radio_pulse_t* pulse = &pulses[symbol];
+	
+	if (pulse->on != 0)
+	{
 		RADIO_ON;
-		_delay_us(PPM_TIME_PULSE);
+		RADIO_TRACE_EDGE();
 		
-		RADIO_OFF;
-		_delay_us(PPM_TIME_PULSE);
+		_delay_loop_2(pulse->on);
 	}
+	
+	RADIO_OFF;
+	RADIO_TRACE_EDGE();
+	
+	radio_delay(pulse->off);
 }
 
-void send_pwm(uint8_t bytes[], uint8_t length, uint8_t repeats)
+void radio_send_repeats(const radio_protocol_t* protocol, uint8_t bytes[], uint8_t length, uint8_t repeats)
 {
-	uint8_t i, j, k, b;
+	radio_pulse_t pulses[kRadioPulseCount];
+	uint8_t stream[RADIO_MAX_BITS + 2];
+	uint8_t flags, shift, i, k, n;
+	uint16_t gap;
+	
+	if (length > RADIO_MAX_BITS)
+	{
+		length = RADIO_MAX_BITS;
+	}
+	
+	memcpy_P(pulses, protocol->pulses, sizeof(pulses));
+	flags = pgm_read_byte(&protocol->flags);
+	gap = pgm_read_word(&protocol->repeat_gap);
+	
+	// Expand the frame into a list of symbols once, so there is no bit
+	// arithmetic between the pulses of the timing loop below
+	n = 0;
+	
+	if (pulses[kRadioSync].on != 0 || pulses[kRadioSync].off != 0)
+	{
+		stream[n++] = kRadioSync;
+	}
+	
+	for (i=0; i<length; i++)
+	{
+		shift = (flags & RADIO_LSB_FIRST) ? (i % 8) : (7 - i % 8);
+		stream[n++] = (bytes[i / 8] >> shift) & 0x01;
+	}
 	
-	for (k=0; k<3; k++)
+	if (pulses[kRadioTrailer].on != 0 || pulses[kRadioTrailer].off != 0)
 	{
-		for (i=0; i<length; i++)
+		stream[n++] = kRadioTrailer;
+	}
+	
+#ifdef TRACE
+	// Only the first repeat is traced, the others take the same code path
+	uint16_t syncStart = 0, syncEnd = 0;
+	uint8_t traced = 0;
+	
+	traceEdgeCount = RADIO_TRACE_EDGES;
+#endif
+	
+	for (i=pgm_read_byte(&protocol->preamble_count); i != 0; i--)
+	{
+		radio_emit(pulses, kRadioPreamble);
+	}
+	
+	for (k=0; k<repeats; k++)
+	{
+		// gap between the repeats
+		if (k != 0)
 		{
-			j = i % 8;
-			b = bytes[i / 8] & (1 << (7 - j));
+			RADIO_OFF;
 			
-			if (b != 0)
+#ifdef TRACE
+			if (k == 1)
 			{
-				RADIO_ON;
-				_delay_us(PWM_TIME_SHORT);
-				
-				RADIO_OFF;
-				_delay_us(PWM_TIME_LONG);
+				syncStart = TCNT1;
 			}
-			else
+#endif
+			
+			radio_delay(gap);
+			
+#ifdef TRACE
+			if (k == 1)
 			{
-				RADIO_ON;
-				_delay_us(PWM_TIME_LONG);
-				
-				RADIO_OFF;
-				_delay_us(PWM_TIME_SHORT);
+				syncEnd = TCNT1;
 			}
+#endif
+		}
+		
+#ifdef TRACE
+		if (k == 0)
+		{
+			traceEdgeCount = 0;
+		}
+#endif
+		
+		for (i=0; i<n; i++)
+		{
+			radio_emit(pulses, stream[i]);
 		}
 		
-		_delay_us(PWM_TIME_GAP);
+#ifdef TRACE
+		if (k == 0)
+		{
+			traced = traceEdgeCount;
+			traceEdgeCount = RADIO_TRACE_EDGES;
+		}
+#endif
+	}
+	
+#ifdef TRACE
+	// the frame is out, recording takes no time from it anymore
+	traceEdgeCount = traced;
+	radio_trace_repeat(pulses, stream, n);
+	
+	if (repeats > 1)
+	{
+		trace_record_period(kTrace_RadioSync, syncStart, syncEnd);
 	}
+#endif
 }
 
-void prologue_send(uint8_t id, uint8_t channel, float temperature, uint8_t humidity, uint8_t battery_status, uint8_t button_pressed)
+void radio_send(const radio_protocol_t* protocol, uint8_t bytes[], uint8_t length)
+{
+	radio_send_repeats(protocol, bytes, length, pgm_read_byte(&protocol->repeats));
+}
+
+void send_ppm(uint8_t bytes[], uint8_t length, uint8_t repeats)
+{
+	radio_send_repeats(&radio_protocol_ppm, bytes, length, repeats);
+}
+
+void send_pwm(uint8_t bytes[], uint8_t length, uint8_t repeats)
+{
+	radio_send_repeats(&radio_protocol_pwm, bytes, length, repeats);
+}
+
+void prologue_send(uint8_t id, uint8_t channel, int16_t temperature, uint8_t humidity, uint8_t battery_status, uint8_t button_pressed)
 {
 	uint8_t bytes[5];
 	uint8_t length;
@@ -111,18 +285,42 @@ void prologue_send(uint8_t id, uint8_t channel, float temperature, uint8_t humid
 	
 	length = 37;
 	
-	
-	t1 = (int16_t) (temperature * 10);
+	t1 = temperature;
 	
 	bytes[0] |= (id & 0xF0) >> 4;
 	bytes[1] |= (id & 0x0F) << 4;
 	bytes[1] |= (battery_status & 0x01) << 3;
-	bytes[1] |= (button_pressed & 0x04) << 2;
+	bytes[1] |= (button_pressed & 0x01) << 2;
 	bytes[1] |= ((channel - 1) & 0x03);
 	bytes[2] |= (t1 & 0x0FF0) >> 4;
 	bytes[3] |= (t1 & 0x000F) << 4;
 	bytes[3] |= (humidity & 0xF0) >> 4;
 	bytes[4] |= (humidity & 0x0F) << 4;
 	
-	send_ppm(bytes, length, 7);
+	radio_send(&radio_protocol_prologue, bytes, length);
+}
+
+void nexus_send(uint8_t id, uint8_t channel, int16_t temperature, uint8_t humidity, uint8_t battery_status)
+{
+	uint8_t bytes[5];
+	int16_t t1;
+	
+	// RTL-433 recognises this device as "Nexus-TH"
+	
+	// identifier (0-255), changes on battery replacement
+	// battery status (0: LOW, 1: OK)
+	// channel (1-3)
+	// temperature (signed 12 bit integer (two's complement), celsius x 10)
+	// constant 0b1111
+	// humidity (percent, 0-100)
+	
+	t1 = temperature;
+	
+	bytes[0] = id;
+	bytes[1] = ((battery_status & 0x01) << 7) | (((channel - 1) & 0x03) << 4) | ((t1 & 0x0F00) >> 8);
+	bytes[2] = t1 & 0x00FF;
+	bytes[3] = 0xF0 | ((humidity & 0xF0) >> 4);
+	bytes[4] = (humidity & 0x0F) << 4;
+	
+	radio_send(&radio_protocol_nexus, bytes, 36);
 }
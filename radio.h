@@ -1,6 +1,7 @@
 #pragma once
 
 #include <avr/io.h>
+#include <avr/pgmspace.h>
 #include <util/delay.h>
 
 #define PWM_TIME_SHORT 500
@@ -12,6 +13,100 @@
 #define PPM_TIME_OFF_1 4020
 #define PPM_TIME_SYNC 8650
 
+#define NEXUS_TIME_PULSE 500
+#define NEXUS_TIME_OFF_0 1000
+#define NEXUS_TIME_OFF_1 2000
+#define NEXUS_TIME_SYNC 4000
+
+// Longest frame accepted by radio_send(), in bits
+#define RADIO_MAX_BITS 64
+
+/**
+ * Convert a duration in microseconds to _delay_loop_2() iterations (4 cycles each)
+ *
+ * This is evaluated at compile time when building the protocol tables, so the
+ * transmit loop does not need any runtime arithmetic for its timings.
+ */
+#define RADIO_US(us) ((uint16_t) (((uint32_t) (us) * (F_CPU / 1000UL) + 2000UL) / 4000UL))
+
+// Cycles radio_emit() adds to the 4 per delay loop iteration, counted on the
+// code avr-gcc -Os emits for it and for the loop of radio_send_repeats()
+// (avr-objdump -d test.o). An edge lands at the end of its sbi/cbi.
+//
+//   pulse  the last brne of the loop falls through (-1), cbi (2)        1
+//   gap    ldd, ldd, sbiw, breq (7), last brne (-1), ret (4), the
+//          symbol loop: subi, cp, brne, ld, movw, rcall (10), the
+//          pulse address: mov, ldi, lsl, rol, lsl, rol, add, adc (8),
+//          ld, ldd, sbiw, breq (7), sbi (2)                            37
+#define RADIO_PULSE_CYCLES 1
+#define RADIO_GAP_CYCLES 37
+
+/**
+ * RADIO_US() less the cycles the transmit loop spends around the delay
+ */
+#define RADIO_LOOPS(us, cycles) \
+	((uint16_t) (((uint32_t) (us) * (F_CPU / 1000UL) - (cycles) * 1000UL + 2000UL) / 4000UL))
+#define RADIO_PULSE_US(us) RADIO_LOOPS(us, RADIO_PULSE_CYCLES)
+#define RADIO_GAP_US(us) RADIO_LOOPS(us, RADIO_GAP_CYCLES)
+
+/**
+ * A single on/off period, durations in RADIO_US() units
+ * A zero on time sends no pulse, a zero off time sends no gap.
+ */
+typedef struct radio_pulse_t {
+	uint16_t on;
+	uint16_t off;
+} radio_pulse_t;
+
+// Indexes of radio_protocol_t.pulses
+enum {
+	kRadioSymbol0 = 0,
+	kRadioSymbol1 = 1,
+	kRadioSync = 2,     // sent at the start of every repeat
+	kRadioTrailer = 3,  // sent at the end of every repeat
+	kRadioPreamble = 4, // sent preamble_count times before the first repeat
+	kRadioPulseCount
+};
+
+// radio_protocol_t.flags
+#define RADIO_LSB_FIRST 0x01
+
+/**
+ * Description of an OOK protocol
+ *
+ * Instances are stored in flash (PROGMEM) and are only accessed through
+ * the pgm_read_* functions.
+ */
+typedef struct radio_protocol_t {
+	radio_pulse_t pulses[kRadioPulseCount];
+
+	// Number of preamble pulses before the first repeat
+	uint8_t preamble_count;
+
+	// Number of times the frame is sent and the off time between them (RADIO_US() units)
+	uint8_t repeats;
+	uint16_t repeat_gap;
+
+	uint8_t flags;
+} radio_protocol_t;
+
+extern const radio_protocol_t radio_protocol_ppm PROGMEM;
+extern const radio_protocol_t radio_protocol_pwm PROGMEM;
+extern const radio_protocol_t radio_protocol_prologue PROGMEM;
+extern const radio_protocol_t radio_protocol_nexus PROGMEM;
+
+/**
+ * Send a frame of length bits (MSB of bytes[0] first unless the protocol
+ * has RADIO_LSB_FIRST) using the repeat count of the protocol
+ */
+void radio_send(const radio_protocol_t* protocol, uint8_t bytes[], uint8_t length);
+
+/**
+ * Same as radio_send() but overrides the repeat count of the protocol
+ */
+void radio_send_repeats(const radio_protocol_t* protocol, uint8_t bytes[], uint8_t length, uint8_t repeats);
+
 void send_ppm(uint8_t bytes[], uint8_t length, uint8_t repeats);
 void send_pwm(uint8_t bytes[], uint8_t length, uint8_t repeats);
-void prologue_send(uint8_t id, uint8_t channel, float temperature, uint8_t humidity, uint8_t battery_status, uint8_t button_pressed);
\ No newline at end of file
+void prologue_send(uint8_t id, uint8_t channel, int16_t temperature, uint8_t humidity, uint8_t battery_status, uint8_t button_pressed);
+void nexus_send(uint8_t id, uint8_t channel, int16_t temperature, uint8_t humidity, uint8_t battery_status);
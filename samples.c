@@ -0,0 +1,304 @@
+#include "samples.h"
+#include "radio.h"
+#include "usart.h"
+
+// C
+#include <stdio.h>
+
+#ifdef SAMPLES_EEPROM
+// AVR
+#include <avr/eeprom.h>
+#endif
+
+static sample_t ring[SAMPLES_SIZE];
+
+// Index of the oldest sample, number of samples and how many of the newest ones are pending
+static uint8_t ringStart;
+static uint8_t ringCount;
+static uint8_t ringPending;
+
+static uint16_t lost;
+
+#ifdef SAMPLES_EEPROM
+
+// Every slot is a tag byte followed by a sample. The tag holds a 7 bit
+// sequence number and bit 7 is set once the sample was sent. Slots are
+// written strictly in order, so every cell wears at the same rate; the
+// write position is found after a restart where the sequence breaks.
+// Erased cells (0xFF) read as a sent sample.
+#define SAMPLES_EEPROM_SENT 0x80
+#define SAMPLES_EEPROM_SLOT_SIZE (1 + sizeof(sample_t))
+
+static uint8_t eepromHead;
+static uint8_t eepromSequence;
+static uint8_t eepromPending;
+
+static uint8_t* eeprom_slot(uint8_t slot)
+{
+	return (uint8_t*) (SAMPLES_EEPROM_OFFSET + slot * SAMPLES_EEPROM_SLOT_SIZE);
+}
+
+static uint8_t eeprom_tag(uint8_t slot)
+{
+	return eeprom_read_byte(eeprom_slot(slot));
+}
+
+static void eeprom_init(void)
+{
+	uint8_t i, next;
+	
+	eepromHead = 0;
+	eepromPending = 0;
+	
+	// Find the end of the last run of consecutive sequence numbers
+	for (i=0; i<SAMPLES_EEPROM_SLOTS; i++)
+	{
+		next = (i + 1) % SAMPLES_EEPROM_SLOTS;
+		
+		if ((eeprom_tag(next) & 0x7F) != ((eeprom_tag(i) + 1) & 0x7F))
+		{
+			eepromHead = next;
+			break;
+		}
+	}
+	
+	eepromSequence = eeprom_tag((eepromHead + SAMPLES_EEPROM_SLOTS - 1) % SAMPLES_EEPROM_SLOTS) + 1;
+	
+	for (i=0; i<SAMPLES_EEPROM_SLOTS; i++)
+	{
+		if (!(eeprom_tag(i) & SAMPLES_EEPROM_SENT))
+		{
+			eepromPending++;
+		}
+	}
+}
+
+static void eeprom_push(const sample_t* sample)
+{
+	uint8_t* slot = eeprom_slot(eepromHead);
+	
+	// Overwriting a sample that was never sent
+	if (!(eeprom_read_byte(slot) & SAMPLES_EEPROM_SENT))
+	{
+		eepromPending--;
+		lost++;
+	}
+	
+	eeprom_update_block(sample, slot + 1, sizeof(sample_t));
+	eeprom_update_byte(slot, eepromSequence & 0x7F);
+	
+	eepromSequence++;
+	eepromHead = (eepromHead + 1) % SAMPLES_EEPROM_SLOTS;
+	eepromPending++;
+}
+
+static bool eeprom_next(sample_t* sample)
+{
+	uint8_t i, slot;
+	
+	if (eepromPending == 0)
+	{
+		return false;
+	}
+	
+	// Oldest first, starting at the write position
+	for (i=0; i<SAMPLES_EEPROM_SLOTS; i++)
+	{
+		slot = (eepromHead + i) % SAMPLES_EEPROM_SLOTS;
+		
+		uint8_t tag = eeprom_tag(slot);
+		
+		if (!(tag & SAMPLES_EEPROM_SENT))
+		{
+			eeprom_read_block(sample, eeprom_slot(slot) + 1, sizeof(sample_t));
+			eeprom_update_byte(eeprom_slot(slot), tag | SAMPLES_EEPROM_SENT);
+			eepromPending--;
+			return true;
+		}
+	}
+	
+	eepromPending = 0;
+	return false;
+}
+
+#else
+
+#define eeprom_init()
+#define eepromPending 0
+
+#endif
+
+void samples_init(void)
+{
+	ringStart = 0;
+	ringCount = 0;
+	ringPending = 0;
+	lost = 0;
+	
+	eeprom_init();
+}
+
+void samples_push(const sample_t* sample)
+{
+	if (ringCount == SAMPLES_SIZE)
+	{
+		// The oldest sample is about to be overwritten
+		if (ringPending == SAMPLES_SIZE)
+		{
+#ifdef SAMPLES_EEPROM
+			eeprom_push(&ring[ringStart]);
+#else
+			lost++;
+#endif
+			ringPending--;
+		}
+		
+		ringStart = (ringStart + 1) % SAMPLES_SIZE;
+		ringCount--;
+	}
+	
+	ring[(ringStart + ringCount) % SAMPLES_SIZE] = *sample;
+	ringCount++;
+	ringPending++;
+}
+
+uint16_t samples_pending(void)
+{
+	return ringPending + eepromPending;
+}
+
+bool samples_batch_due(uint16_t now)
+{
+	uint16_t pending = samples_pending();
+	
+	if (pending == 0)
+	{
+		return false;
+	}
+	
+	if (pending >= SAMPLES_BATCH || eepromPending != 0)
+	{
+		return true;
+	}
+	
+	// Age of the oldest pending sample, unsigned arithmetic handles the wrap
+	const sample_t* oldest = &ring[(ringStart + ringCount - ringPending) % SAMPLES_SIZE];
+	
+	return (uint16_t) (now - oldest->time) >= SAMPLES_MAX_AGE;
+}
+
+bool samples_next(sample_t* sample)
+{
+#ifdef SAMPLES_EEPROM
+	// Samples in the EEPROM are older than everything in SRAM
+	if (eeprom_next(sample))
+	{
+		return true;
+	}
+#endif
+	
+	if (ringPending == 0)
+	{
+		return false;
+	}
+	
+	*sample = ring[(ringStart + ringCount - ringPending) % SAMPLES_SIZE];
+	ringPending--;
+	
+	return true;
+}
+
+/**
+ * Field of a batch frame: sensor:8 age:10 temperature:12
+ */
+static uint32_t frame_field(const sample_t* sample, uint16_t now)
+{
+	uint16_t age = now - sample->time;
+	int16_t temperature = (sample->temperature * 10) / 16;
+	
+	if (age > SAMPLES_FRAME_AGE_MAX)
+	{
+		age = SAMPLES_FRAME_AGE_MAX;
+	}
+	
+	return ((uint32_t) sample->sensor << 22) | ((uint32_t) age << 12) | (temperature & 0x0FFF);
+}
+
+void samples_send(uint16_t now)
+{
+	sample_t sample;
+	uint32_t first, second, word;
+	uint8_t bytes[8];
+	uint8_t i;
+	bool separate = false;
+	
+	while (samples_next(&sample))
+	{
+		// The frame ends with a short gap, keep the next one apart like a repeat
+		if (separate)
+		{
+			_delay_us(PPM_TIME_SYNC);
+		}
+		
+		separate = true;
+		first = frame_field(&sample, now);
+		second = (uint32_t) SAMPLES_FRAME_EMPTY << 22;
+		
+		if (samples_next(&sample))
+		{
+			second = frame_field(&sample, now);
+		}
+		
+		// type:4 first:30 second:30, MSB first
+		for (i=0; i<8; i++)
+		{
+			word = (i < 4) ? ((uint32_t) SAMPLES_FRAME_TYPE << 28) | (first >> 2) : (first << 30) | second;
+			bytes[i] = word >> (24 - 8 * (i & 3));
+		}
+		
+		radio_send_repeats(&radio_protocol_prologue, bytes, 64, SAMPLES_FRAME_REPEATS);
+	}
+}
+
+uint16_t samples_lost(void)
+{
+	return lost;
+}
+
+static void dump_sample(const sample_t* sample, bool pending)
+{
+	char s[30];
+	
+	sprintf(s, "%u %u %d%s\r\n", sample->time, sample->sensor,
+		(sample->temperature * 10) / 16, pending ? " *" : "");
+	USART_TransmitString((unsigned char*) s);
+}
+
+void samples_dump(void)
+{
+	uint8_t i;
+	char s[40];
+	
+	sprintf(s, "samples: %u pending, %u lost\r\n", samples_pending(), lost);
+	USART_TransmitString((unsigned char*) s);
+
+#ifdef SAMPLES_EEPROM
+	sample_t sample;
+	
+	for (i=0; i<SAMPLES_EEPROM_SLOTS; i++)
+	{
+		uint8_t slot = (eepromHead + i) % SAMPLES_EEPROM_SLOTS;
+		
+		if (!(eeprom_tag(slot) & SAMPLES_EEPROM_SENT))
+		{
+			eeprom_read_block(&sample, eeprom_slot(slot) + 1, sizeof(sample_t));
+			dump_sample(&sample, true);
+		}
+	}
+#endif
+	
+	for (i=0; i<ringCount; i++)
+	{
+		dump_sample(&ring[(ringStart + i) % SAMPLES_SIZE], i >= ringCount - ringPending);
+	}
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+// C
+#include <stdbool.h>
+#include <stdint.h>
+
+// Store-and-forward buffer of measurements
+//
+// Samples are kept in an SRAM ring until they are transmitted. When the ring
+// is full the oldest sample is dropped, or with SAMPLES_EEPROM defined
+// (SAMPLES_EEPROM=1 ./build.sh) moved into a wear-levelled ring in EEPROM.
+// main.c sends every sample as a Prologue frame right after the reading, so
+// rtl_433 and Domoticz keep receiving them. With SAMPLES_FRAMES defined
+// (SAMPLES_FRAMES=1 ./build.sh) transmission is batched instead, for
+// receivers that decode the frames below (host/gateway.c):
+// samples_batch_due() tells when enough samples are waiting to be worth a
+// radio burst, samples_send() packs them two to a frame.
+//
+// The radio has no acknowledgement, so a sample counts as delivered once it
+// is sent. The ring only fills up (and spills into the EEPROM) while the
+// transmissions are held back, like when main.c has the radio switched off.
+
+// SRAM ring size (5 bytes per sample)
+#define SAMPLES_SIZE 32
+
+// Send when this many samples are waiting...
+#define SAMPLES_BATCH 4
+
+// ...or when the oldest waiting sample is this old (seconds)
+#define SAMPLES_MAX_AGE 300
+
+// Type of the batch frames and the largest age they carry (seconds)
+#define SAMPLES_FRAME_TYPE 0x4
+#define SAMPLES_FRAME_AGE_MAX 1023
+
+// Times each batch frame is sent: two identical rows make up for the missing
+// checksum, the third one covers a lost row. The Prologue frames are sent 7
+// times because rtl_433 wants 4 identical rows.
+#define SAMPLES_FRAME_REPEATS 3
+
+// Sensor of the unused second field of a frame
+#define SAMPLES_FRAME_EMPTY 0xFF
+
+// EEPROM ring: 6 bytes per slot, must be less than 128 slots
+#define SAMPLES_EEPROM_OFFSET 0
+#define SAMPLES_EEPROM_SLOTS 100
+
+/**
+ * A single measurement
+ */
+typedef struct sample_t {
+	// Seconds since start (wraps after ~18 hours)
+	uint16_t time;
+
+	// Sensor identifier, meaning defined by the caller (main.c stores the
+	// sensors.h handle, which it logs with the ROM code on the USART)
+	uint8_t sensor;
+
+	// 1/16 degrees C (Q12.4)
+	int16_t temperature;
+} sample_t;
+
+/**
+ * Clear the SRAM ring and locate the EEPROM ring
+ */
+void samples_init(void);
+
+/**
+ * Store a new sample
+ */
+void samples_push(const sample_t* sample);
+
+/**
+ * Number of samples not transmitted yet
+ */
+uint16_t samples_pending(void);
+
+/**
+ * True if the pending samples should be transmitted now
+ */
+bool samples_batch_due(uint16_t now);
+
+/**
+ * Take the oldest sample that was not transmitted yet
+ * @returns false if there is none
+ */
+bool samples_next(sample_t* sample);
+
+/**
+ * Send all pending samples, two per frame: 64 bits with Prologue timings,
+ * repeated SAMPLES_FRAME_REPEATS times
+ *
+ *   type:4 (0x4) then twice sensor:8 age:10 temperature:12
+ *
+ * The age is now minus the sample time in seconds, SAMPLES_FRAME_AGE_MAX
+ * for older samples, so the receiver can date the samples and keep those
+ * of the same sensor apart. Samples recovered from the EEPROM after a reset
+ * keep the times of the previous run. The temperature is in tenths of a
+ * degree as in Prologue frames. An odd last sample is followed by an empty
+ * field with sensor SAMPLES_FRAME_EMPTY.
+ */
+void samples_send(uint16_t now);
+
+/**
+ * Number of samples dropped because the buffer was full
+ */
+uint16_t samples_lost(void);
+
+/**
+ * Send the buffer contents over the USART, oldest first
+ * Lines are "time sensor temperature*10", pending samples are marked with "*".
+ */
+void samples_dump(void);
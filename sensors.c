@@ -0,0 +1,254 @@
+#include "sensors.h"
+#include "crc.h"
+#include "ds18b20.h"
+#include "usart.h"
+
+// C
+#include <stdio.h>
+#include <string.h>
+
+// AVR
+#include <avr/pgmspace.h>
+
+// info byte: family index:3 resolution:2 read mode:2
+#define INFO_FAMILY_MASK 0x07
+#define INFO_RESOLUTION_SHIFT 3
+#define INFO_RESOLUTION_MASK (0x03 << INFO_RESOLUTION_SHIFT)
+#define INFO_MODE_SHIFT 5
+#define INFO_MODE_MASK (0x03 << INFO_MODE_SHIFT)
+
+#ifdef SENSORS_FULL_ROM
+#define SENSORS_ROM_SIZE 8
+#else
+#define SENSORS_ROM_SIZE 6
+
+// Families that can be stored as an index in the info byte
+static const uint8_t kFamilies[] PROGMEM = { 0x10, 0x22, 0x28, 0x3B };
+
+#define SENSORS_FAMILIES (sizeof(kFamilies) / sizeof(kFamilies[0]))
+#endif
+
+static uint8_t rom[SENSORS_MAX][SENSORS_ROM_SIZE];
+static uint8_t info[SENSORS_MAX];
+static uint8_t status[SENSORS_MAX];
+static int16_t reading[SENSORS_MAX];
+static uint16_t readingTime[SENSORS_MAX];
+static stats_sensor_t counters[SENSORS_MAX];
+
+static uint8_t count;
+
+#ifdef __AVR__
+// Keep the RAM cost documented in sensors.h honest
+_Static_assert(SENSORS_ROM_SIZE + sizeof(info[0]) + sizeof(status[0]) + sizeof(reading[0]) +
+	sizeof(readingTime[0]) + sizeof(counters[0]) == SENSORS_BYTES_PER_SENSOR, "sensor size");
+#endif
+
+_Static_assert(SENSORS_MAX < SENSORS_NONE, "SENSORS_MAX must be less than 255");
+
+void sensors_init(void)
+{
+	count = 0;
+	
+	memset(status, 0, sizeof(status));
+	memset(counters, 0, sizeof(counters));
+}
+
+uint8_t sensors_count(void)
+{
+	return count;
+}
+
+void sensors_begin_scan(void)
+{
+	for (sensor_t s = 0; s < count; s++)
+	{
+		status[s] &= ~SENSOR_PRESENT;
+	}
+}
+
+/**
+ * Stored form of a ROM code
+ * @returns false if the family cannot be stored
+ */
+static bool sensors_pack(const uint8_t* address, uint8_t* packed, uint8_t* family)
+{
+#ifdef SENSORS_FULL_ROM
+	memcpy(packed, address, 8);
+	*family = 0;
+	
+	return true;
+#else
+	// Serial number only, the family becomes an index and the CRC is recomputed
+	memcpy(packed, address + 1, 6);
+	
+	for (*family = 0; *family < SENSORS_FAMILIES; (*family)++)
+	{
+		if (pgm_read_byte(&kFamilies[*family]) == address[0])
+		{
+			return true;
+		}
+	}
+	
+	return false;
+#endif
+}
+
+static sensor_t sensors_lookup(const uint8_t* packed, uint8_t family)
+{
+	for (sensor_t s = 0; s < count; s++)
+	{
+		if ((info[s] & INFO_FAMILY_MASK) == family && memcmp(rom[s], packed, SENSORS_ROM_SIZE) == 0)
+		{
+			return s;
+		}
+	}
+	
+	return SENSORS_NONE;
+}
+
+sensor_t sensors_find(const uint8_t* address)
+{
+	uint8_t packed[SENSORS_ROM_SIZE];
+	uint8_t family;
+	
+	if (!sensors_pack(address, packed, &family))
+	{
+		return SENSORS_NONE;
+	}
+	
+	return sensors_lookup(packed, family);
+}
+
+sensor_t sensors_add(const uint8_t* address)
+{
+	uint8_t packed[SENSORS_ROM_SIZE];
+	uint8_t family;
+	
+	if (!sensors_pack(address, packed, &family))
+	{
+		return SENSORS_NONE;
+	}
+	
+	sensor_t s = sensors_lookup(packed, family);
+	
+	if (s == SENSORS_NONE)
+	{
+		if (count == SENSORS_MAX)
+		{
+			return SENSORS_NONE;
+		}
+		
+		s = count++;
+		
+		memcpy(rom[s], packed, SENSORS_ROM_SIZE);
+		info[s] = family | (3 << INFO_RESOLUTION_SHIFT) | (kDS18B20_ReadFull << INFO_MODE_SHIFT);
+		status[s] = 0;
+		reading[s] = 0;
+		readingTime[s] = 0;
+		memset(&counters[s], 0, sizeof(counters[s]));
+	}
+	
+	status[s] |= SENSOR_PRESENT;
+	
+	return s;
+}
+
+void sensors_rom(sensor_t sensor, uint8_t* address)
+{
+#ifdef SENSORS_FULL_ROM
+	memcpy(address, rom[sensor], 8);
+#else
+	address[0] = pgm_read_byte(&kFamilies[info[sensor] & INFO_FAMILY_MASK]);
+	memcpy(address + 1, rom[sensor], 6);
+	address[7] = crc8(address, 7);
+#endif
+}
+
+uint8_t sensors_family(sensor_t sensor)
+{
+#ifdef SENSORS_FULL_ROM
+	return rom[sensor][0];
+#else
+	return pgm_read_byte(&kFamilies[info[sensor] & INFO_FAMILY_MASK]);
+#endif
+}
+
+uint8_t sensors_status(sensor_t sensor)
+{
+	return status[sensor];
+}
+
+void sensors_set_status(sensor_t sensor, uint8_t flags, bool on)
+{
+	if (on)
+	{
+		status[sensor] |= flags;
+	}
+	else
+	{
+		status[sensor] &= ~flags;
+	}
+}
+
+uint8_t sensors_read_mode(sensor_t sensor)
+{
+	return (info[sensor] & INFO_MODE_MASK) >> INFO_MODE_SHIFT;
+}
+
+void sensors_set_read_mode(sensor_t sensor, uint8_t mode)
+{
+	info[sensor] = (info[sensor] & ~INFO_MODE_MASK) | ((mode << INFO_MODE_SHIFT) & INFO_MODE_MASK);
+}
+
+uint8_t sensors_resolution(sensor_t sensor)
+{
+	return (info[sensor] & INFO_RESOLUTION_MASK) >> INFO_RESOLUTION_SHIFT;
+}
+
+void sensors_set_resolution(sensor_t sensor, uint8_t resolution)
+{
+	info[sensor] = (info[sensor] & ~INFO_RESOLUTION_MASK) |
+		((resolution << INFO_RESOLUTION_SHIFT) & INFO_RESOLUTION_MASK);
+}
+
+void sensors_set_reading(sensor_t sensor, int16_t value, uint16_t when)
+{
+	reading[sensor] = value;
+	readingTime[sensor] = when;
+	status[sensor] |= SENSOR_VALID;
+}
+
+int16_t sensors_reading(sensor_t sensor)
+{
+	return reading[sensor];
+}
+
+uint16_t sensors_time(sensor_t sensor)
+{
+	return readingTime[sensor];
+}
+
+stats_sensor_t* sensors_stats(sensor_t sensor)
+{
+	return &counters[sensor];
+}
+
+void sensors_dump(void)
+{
+	char s[70];
+	uint8_t a[8];
+	
+	sprintf(s, "sensors: %u of %u\r\n", count, SENSORS_MAX);
+	USART_TransmitString((unsigned char*) s);
+	
+	for (sensor_t i = 0; i < count; i++)
+	{
+		sensors_rom(i, a);
+		
+		sprintf(s, "%u %02x%02x%02x%02x%02x%02x%02x%02x %02x %d %u %u %u %u %u\r\n", i,
+			a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], status[i],
+			(int) (((int32_t) reading[i] * 10) / 16), readingTime[i],
+			counters[i].reads, counters[i].crcFailures, counters[i].invalid, counters[i].retries);
+		USART_TransmitString((unsigned char*) s);
+	}
+}
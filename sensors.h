@@ -0,0 +1,130 @@
+#pragma once
+
+#include "stats.h"
+
+// C
+#include <stdbool.h>
+#include <stdint.h>
+
+// Registry of the sensors found on the bus
+//
+// Every sensor gets a 1 byte handle, its index in a set of arrays sized at
+// compile time by SENSORS_MAX (-DSENSORS_MAX=n). RAM per sensor:
+//
+//   ROM                6 bytes  serial number; the family is stored as an
+//                               index in info and the CRC is recomputed
+//                               (8 bytes with -DSENSORS_FULL_ROM)
+//   info               1 byte   family index:3 resolution:2 read mode:2
+//   status             1 byte   SENSOR_* flags
+//   reading            2 bytes  last temperature, Q12.4
+//   time               2 bytes  time of the last reading, seconds
+//   counters           5 bytes  stats_sensor_t
+//                     --------
+//                     17 bytes  (19 with full ROM codes)
+//
+// Estimated SRAM of the default build (avr-gcc keeps the string literals in
+// .data), against the 2048 bytes of the ATmega328P:
+//
+//                      32 sensors  64 sensors
+//   registry              545        1089
+//   sample ring           166         166  SAMPLES_SIZE * 5 + indexes
+//   stats, ds18b20         27          27
+//   strings in .data      555         555
+//   stack peak            260         260  main, sensors_dump(), sprintf()
+//                      --------    --------
+//                        1553        2097
+//
+// TRACE builds add about 450 bytes (records, channel statistics, names), so
+// 32 is the largest power of two that fits both.
+
+#ifndef SENSORS_MAX
+#define SENSORS_MAX 32
+#endif
+
+#ifdef SENSORS_FULL_ROM
+#define SENSORS_BYTES_PER_SENSOR 19
+#else
+#define SENSORS_BYTES_PER_SENSOR 17
+#endif
+
+// Handle of a sensor, SENSORS_NONE if there is none
+typedef uint8_t sensor_t;
+
+#define SENSORS_NONE 0xFF
+
+// Status flags
+#define SENSOR_PRESENT 0x01  // found by the last scan
+#define SENSOR_VALID 0x02    // the last reading succeeded
+#define SENSOR_PARASITE 0x04 // parasite powered (Read Power Supply when found)
+#define SENSOR_CRC_ERROR 0x08 // the last read failed the CRC check
+
+/**
+ * Forget all sensors
+ */
+void sensors_init(void);
+
+/**
+ * Number of sensors in the registry, handles are 0 to sensors_count() - 1
+ */
+uint8_t sensors_count(void);
+
+/**
+ * Clear SENSOR_PRESENT on all sensors before a new search of the bus
+ */
+void sensors_begin_scan(void);
+
+/**
+ * Register a sensor found on the bus, or find it if it is known already,
+ * and mark it present
+ *
+ * @returns its handle, SENSORS_NONE if the registry is full or (with
+ * compressed ROM codes) the family is not supported
+ */
+sensor_t sensors_add(const uint8_t* rom);
+
+/**
+ * Handle of a known sensor, or SENSORS_NONE
+ */
+sensor_t sensors_find(const uint8_t* rom);
+
+/**
+ * Full 8 byte ROM code of a sensor
+ */
+void sensors_rom(sensor_t sensor, uint8_t* rom);
+
+uint8_t sensors_family(sensor_t sensor);
+
+uint8_t sensors_status(sensor_t sensor);
+void sensors_set_status(sensor_t sensor, uint8_t flags, bool on);
+
+/**
+ * Scratch pad read mode (kDS18B20_Read*), kDS18B20_ReadFull for new sensors
+ */
+uint8_t sensors_read_mode(sensor_t sensor);
+void sensors_set_read_mode(sensor_t sensor, uint8_t mode);
+
+/**
+ * Configured resolution, 0 (9 bits) to 3 (12 bits, the default), as found
+ * by the last full scratch pad read and used to decode the fast reads
+ */
+uint8_t sensors_resolution(sensor_t sensor);
+void sensors_set_resolution(sensor_t sensor, uint8_t resolution);
+
+/**
+ * Store a successful reading and set SENSOR_VALID
+ */
+void sensors_set_reading(sensor_t sensor, int16_t reading, uint16_t time);
+
+/**
+ * Last valid reading (Q12.4) and when it was taken
+ */
+int16_t sensors_reading(sensor_t sensor);
+uint16_t sensors_time(sensor_t sensor);
+
+stats_sensor_t* sensors_stats(sensor_t sensor);
+
+/**
+ * Send the registry over the USART, one line per sensor:
+ * "handle rom status temperature*10 time reads crc invalid retries"
+ */
+void sensors_dump(void);
@@ -0,0 +1,61 @@
+#include "stats.h"
+#include "radio.h"
+#include "usart.h"
+
+// C
+#include <stdio.h>
+#include <string.h>
+
+stats_bus_t stats_bus;
+
+void stats_clear(void)
+{
+    memset(&stats_bus, 0, sizeof(stats_bus));
+}
+
+uint32_t stats_bus_time(void)
+{
+    // Split the products so they do not overflow 32 bits
+    return (stats_bus.resets / 1000) * STATS_RESET_US +
+        (stats_bus.resets % 1000) * STATS_RESET_US / 1000 +
+        (stats_bus.slots / 1000) * STATS_SLOT_US +
+        (stats_bus.slots % 1000) * STATS_SLOT_US / 1000;
+}
+
+void stats_dump(void)
+{
+    char s[60];
+
+    sprintf(s, "stats: %lu resets, %lu slots, %lu ms\r\n", (unsigned long) stats_bus.resets,
+        (unsigned long) stats_bus.slots, (unsigned long) stats_bus_time());
+    USART_TransmitString((unsigned char*) s);
+
+    sprintf(s, "no presence %u, search aborts %u\r\n",
+        stats_bus.presenceFailures, stats_bus.searchAborts);
+    USART_TransmitString((unsigned char*) s);
+
+    sprintf(s, "crc rom %u, scratch pad %u, retries %u\r\n",
+        stats_bus.romCrcFailures, stats_bus.scratchPadCrcFailures, stats_bus.retries);
+    USART_TransmitString((unsigned char*) s);
+}
+
+static uint8_t saturate(uint32_t value)
+{
+    return value > 0xFF ? 0xFF : value;
+}
+
+void stats_send(void)
+{
+    uint8_t presence = saturate(stats_bus.presenceFailures);
+    uint8_t crc = saturate((uint32_t) stats_bus.romCrcFailures + stats_bus.scratchPadCrcFailures);
+    uint8_t retries = saturate(stats_bus.retries);
+    uint8_t bytes[5];
+
+    bytes[0] = (STATS_RADIO_TYPE << 4) | (STATS_RADIO_ID >> 4);
+    bytes[1] = (STATS_RADIO_ID << 4) | (presence >> 4);
+    bytes[2] = (presence << 4) | (crc >> 4);
+    bytes[3] = (crc << 4) | (retries >> 4);
+    bytes[4] = (retries << 4) | ((stats_bus.searchAborts != 0) << 3);
+
+    radio_send(&radio_protocol_prologue, bytes, 37);
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+// C
+#include <stdint.h>
+
+// Bus health counters
+//
+// onewire.c (or onewire_uart.c) and ds18b20.c count resets, slots and
+// failures on the bus in stats_bus, main.c keeps per-sensor counters in the
+// sensor registry (sensors.h). Counters saturate instead of wrapping. They
+// are sent over the USART with stats_dump() ('s' command) and, when built
+// with -DSTATS_RADIO (STATS_RADIO=1 ./build.sh), in a periodic radio health
+// frame.
+
+// Nominal bus time of a reset and of a slot, used to estimate the bus time
+#define STATS_RESET_US 1010
+#define STATS_SLOT_US 61
+
+// Seconds between two health frames
+#define STATS_RADIO_INTERVAL 3600
+
+// Type and radio id of the health frame
+#define STATS_RADIO_TYPE 0x3
+#define STATS_RADIO_ID 0xFE
+
+/**
+ * Counters of the bus
+ */
+typedef struct stats_bus_t {
+    uint32_t resets;
+    uint32_t slots;
+
+    // Resets without a presence pulse
+    uint16_t presenceFailures;
+
+    // Searches stopped by a "11" read (no device answered)
+    uint16_t searchAborts;
+
+    uint16_t romCrcFailures;
+    uint16_t scratchPadCrcFailures;
+
+    // Scratch pad reads repeated after a failure
+    uint16_t retries;
+} stats_bus_t;
+
+/**
+ * Counters of a single sensor
+ */
+typedef struct stats_sensor_t {
+    uint16_t reads;
+    uint8_t crcFailures;
+
+    // Fast reads rejected by validation, or device not answering
+    uint8_t invalid;
+
+    uint8_t retries;
+} stats_sensor_t;
+
+extern stats_bus_t stats_bus;
+
+// Add one to a counter without wrapping
+#define STATS_INC(counter) do { if ((__typeof__(counter)) ((counter) + 1) != 0) (counter)++; } while (0)
+
+/**
+ * Clear all counters
+ */
+void stats_clear(void);
+
+/**
+ * Estimated time spent on the bus since the last stats_clear(), in milliseconds
+ */
+uint32_t stats_bus_time(void);
+
+/**
+ * Send the bus counters over the USART
+ */
+void stats_dump(void);
+
+/**
+ * Send the health frame: 37 bits with Prologue timings
+ *
+ *   type:4 (0x3) id:8 presence failures:8 CRC failures:8 retries:8 search aborts:1
+ *
+ * Counts saturate at 255. rtl_433 ignores the type, so it never shows up as
+ * a temperature reading.
+ */
+void stats_send(void);
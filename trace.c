@@ -0,0 +1,175 @@
+#include "trace.h"
+
+#ifdef TRACE
+
+#include "onewire_timing.h"
+#include "radio.h"
+#include "usart.h"
+
+// C
+#include <stdio.h>
+
+typedef struct trace_record_t {
+    uint8_t channel;
+    uint16_t start;
+    uint16_t ticks;
+} trace_record_t;
+
+typedef struct trace_stats_t {
+    // Saturates at UINT16_MAX, sum stops with it so the mean stays right
+    uint16_t count;
+    uint16_t min;
+    uint16_t max;
+    uint32_t sum;
+} trace_stats_t;
+
+static trace_record_t buffer[TRACE_BUFFER_SIZE];
+static uint8_t bufferCount;
+static uint16_t dropped;
+
+static trace_stats_t stats[kTrace_ChannelCount];
+static uint32_t busTicks;
+
+static const char* const names[kTrace_ChannelCount] = {
+    "ow reset",
+    "ow write0",
+    "ow write1",
+    "ow read",
+    "rf pulse",
+    "rf gap0",
+    "rf gap1",
+    "rf sync",
+};
+
+// Nominal length of each period in microseconds, the slots are timed from
+// their falling edge to the end of the recovery time (onewire_timing.h)
+static const uint16_t targets[kTrace_ChannelCount] = {
+    ONEWIRE_RESET_LOW_US + ONEWIRE_PRESENCE_US + ONEWIRE_RESET_END_US,
+    ONEWIRE_WRITE0_LOW_US + ONEWIRE_RECOVERY_US,
+    ONEWIRE_SLOT_US + ONEWIRE_RECOVERY_US,
+    ONEWIRE_SLOT_US + ONEWIRE_RECOVERY_US,
+    PPM_TIME_PULSE,
+    PPM_TIME_OFF_0,
+    PPM_TIME_OFF_1,
+    PPM_TIME_SYNC,
+};
+
+static uint32_t ticks_to_us(uint32_t ticks)
+{
+    return ticks * TRACE_PRESCALER / (F_CPU / 1000000UL);
+}
+
+void trace_init(void)
+{
+    // Normal mode, free running
+    TCCR1A = 0;
+    TCCR1B = (TRACE_PRESCALER == 1) ? _BV(CS10) :
+             (TRACE_PRESCALER == 8) ? _BV(CS11) : (_BV(CS11) | _BV(CS10));
+
+    trace_clear();
+}
+
+void trace_record(uint8_t channel, uint16_t start)
+{
+    trace_record_period(channel, start, TCNT1);
+}
+
+void trace_record_period(uint8_t channel, uint16_t start, uint16_t end)
+{
+    // Unsigned arithmetic handles a single wrap of the timer
+    uint16_t ticks = end - start;
+    trace_stats_t* s = &stats[channel];
+
+    if (bufferCount < TRACE_BUFFER_SIZE) {
+        buffer[bufferCount].channel = channel;
+        buffer[bufferCount].start = start;
+        buffer[bufferCount].ticks = ticks;
+        bufferCount++;
+    } else {
+        dropped++;
+    }
+
+    if (s->count == 0 || ticks < s->min) {
+        s->min = ticks;
+    }
+
+    if (ticks > s->max) {
+        s->max = ticks;
+    }
+
+    if (s->count != UINT16_MAX) {
+        s->count++;
+        s->sum += ticks;
+    }
+
+    if (channel < kTrace_FirstRadioChannel) {
+        busTicks += ticks;
+    }
+}
+
+void trace_clear(void)
+{
+    for (uint8_t i = 0; i < kTrace_ChannelCount; ++i) {
+        stats[i].count = 0;
+        stats[i].min = 0;
+        stats[i].max = 0;
+        stats[i].sum = 0;
+    }
+
+    bufferCount = 0;
+    dropped = 0;
+    busTicks = 0;
+}
+
+void trace_dump(void)
+{
+    char s[60];
+
+    USART_TransmitString((unsigned char*) "trace: channel start us\r\n");
+
+    for (uint8_t i = 0; i < bufferCount; ++i) {
+        sprintf(s, "%s %u %lu\r\n", names[buffer[i].channel], buffer[i].start,
+            (unsigned long) ticks_to_us(buffer[i].ticks));
+        USART_TransmitString((unsigned char*) s);
+    }
+
+    sprintf(s, "dropped %u\r\n", dropped);
+    USART_TransmitString((unsigned char*) s);
+
+    USART_TransmitString((unsigned char*) "trace: channel count min max mean target error (us)\r\n");
+
+    for (uint8_t i = 0; i < kTrace_ChannelCount; ++i) {
+        if (stats[i].count == 0) {
+            continue;
+        }
+
+        uint32_t mean = trace_mean_us(i);
+
+        sprintf(s, "%s %u %lu %lu %lu %u %ld\r\n", names[i], stats[i].count,
+            (unsigned long) ticks_to_us(stats[i].min), (unsigned long) ticks_to_us(stats[i].max),
+            (unsigned long) mean, targets[i], (long) mean - targets[i]);
+        USART_TransmitString((unsigned char*) s);
+    }
+}
+
+uint32_t trace_mean_us(uint8_t channel)
+{
+    return stats[channel].count == 0 ? 0 : ticks_to_us(stats[channel].sum) / stats[channel].count;
+}
+
+uint16_t trace_target_us(uint8_t channel)
+{
+    return targets[channel];
+}
+
+uint32_t trace_bus_time(void)
+{
+    return ticks_to_us(busTicks);
+}
+
+void trace_bus_time_clear(void)
+{
+    busTicks = 0;
+}
+
+#endif
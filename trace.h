@@ -0,0 +1,99 @@
+#pragma once
+
+// C
+#include <stdint.h>
+
+// Timing instrumentation, enabled by building with -DTRACE (TRACE=1 ./build.sh)
+//
+// Timer1 runs freely with a prescaler of TRACE_PRESCALER. Hot paths take a
+// timestamp with TRACE_START() and hand it to trace_record() through
+// TRACE_STOP() once the measured period is over. The radio can't spend that
+// time between its pulses, it keeps the timestamps and records them with
+// trace_record_period() after the frame. Without TRACE all of this compiles
+// to nothing.
+
+#define TRACE_PRESCALER 8
+
+// Number of raw records kept for trace_dump()
+#define TRACE_BUFFER_SIZE 32
+
+/**
+ * Measured periods
+ * Radio channels are compared against the PPM_TIME_* (Prologue) targets.
+ */
+enum {
+    kTrace_OneWireReset,
+    kTrace_OneWireWrite0,
+    kTrace_OneWireWrite1,
+    kTrace_OneWireRead,
+    kTrace_RadioPulse,
+    kTrace_RadioGap0,
+    kTrace_RadioGap1,
+    kTrace_RadioSync,
+    kTrace_ChannelCount
+};
+
+// First channel that is not 1-Wire bus time
+#define kTrace_FirstRadioChannel kTrace_RadioPulse
+
+#ifdef TRACE
+
+// AVR
+#include <avr/io.h>
+
+#define TRACE_START(var) uint16_t var = TCNT1
+#define TRACE_STOP(channel, var) trace_record((channel), (var))
+
+/**
+ * Start Timer1 and clear all statistics
+ */
+void trace_init(void);
+
+/**
+ * Record the period from start (a TCNT1 value) until now
+ */
+void trace_record(uint8_t channel, uint16_t start);
+
+/**
+ * Record the period from start to end (TCNT1 values) taken earlier, for
+ * periods that can't afford the time of trace_record() at their end
+ */
+void trace_record_period(uint8_t channel, uint16_t start, uint16_t end);
+
+/**
+ * Clear the raw buffer and all statistics
+ */
+void trace_clear(void);
+
+/**
+ * Send the raw buffer and per channel min/max/mean over the USART
+ */
+void trace_dump(void);
+
+/**
+ * Mean of the periods recorded on a channel and the nominal length they are
+ * compared against in trace_dump(), in microseconds (mean 0 without records)
+ */
+uint32_t trace_mean_us(uint8_t channel);
+uint16_t trace_target_us(uint8_t channel);
+
+/**
+ * Time spent on the 1-Wire bus since the last trace_bus_time_clear(), in microseconds
+ */
+uint32_t trace_bus_time(void);
+void trace_bus_time_clear(void);
+
+#else
+
+#define TRACE_START(var)
+#define TRACE_STOP(channel, var)
+
+#define trace_init()
+#define trace_clear()
+#define trace_dump()
+#define trace_mean_us(channel) 0
+#define trace_target_us(channel) 0
+#define trace_bus_time() 0
+#define trace_bus_time_clear()
+
+#endif
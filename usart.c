@@ -1,11 +1,66 @@
 #include "usart.h"
 
+#ifdef ONEWIRE_UART
+
+#include <util/delay.h>
+
+void USART_Init(unsigned int ubrr)
+{
+	/* Idle line is high */
+	SOFT_TX_PORT |= (1 << SOFT_TX_PIN);
+	SOFT_TX_DDR |= (1 << SOFT_TX_PIN);
+}
+
+void USART_Transmit(unsigned char data)
+{
+	unsigned char i;
+	
+	/* Start bit */
+	SOFT_TX_PORT &= ~(1 << SOFT_TX_PIN);
+	__builtin_avr_delay_cycles(SOFT_TX_BIT_CYCLES - SOFT_TX_LOOP_CYCLES);
+	
+	/* 8 data bits, LSB first */
+	for (i=0; i<8; i++)
+	{
+		if (data & 0x01)
+		{
+			SOFT_TX_PORT |= (1 << SOFT_TX_PIN);
+		}
+		else
+		{
+			SOFT_TX_PORT &= ~(1 << SOFT_TX_PIN);
+		}
+		
+		data >>= 1;
+		__builtin_avr_delay_cycles(SOFT_TX_BIT_CYCLES - SOFT_TX_LOOP_CYCLES);
+	}
+	
+	/* 2 stop bits */
+	SOFT_TX_PORT |= (1 << SOFT_TX_PIN);
+	__builtin_avr_delay_cycles(2 * SOFT_TX_BIT_CYCLES - SOFT_TX_LOOP_CYCLES);
+}
+
+unsigned char USART_DataAvailable(void)
+{
+	return 0;
+}
+
+unsigned char USART_Receive(void)
+{
+	return 0;
+}
+
+#else
+
 void USART_Init(unsigned int ubrr)
 {
 	/* Set baud rate */
 	UBRR0H = (unsigned char) (ubrr >> 8);
 	UBRR0L = (unsigned char) ubrr;
 	
+	/* Double speed, see MYUBRR */
+	UCSR0A = (1 << U2X0);
+	
 	/* Enable receiver and transmitter */
 	UCSR0B = (1 << RXEN0) | (1 << TXEN0);
 	
@@ -22,6 +77,22 @@ void USART_Transmit(unsigned char data)
 	UDR0 = data;
 }
 
+unsigned char USART_DataAvailable(void)
+{
+	return UCSR0A & (1<<RXC0);
+}
+
+unsigned char USART_Receive(void)
+{
+	/* Wait for data to be received */
+	while (!(UCSR0A & (1<<RXC0)));
+	
+	/* Get and return received data from buffer */
+	return UDR0;
+}
+
+#endif
+
 void USART_TransmitString(unsigned char a[])
 {
 	unsigned char i;
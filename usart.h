@@ -4,8 +4,26 @@
 #include <stdio.h>
 
 #define BAUD 9600
-#define MYUBRR F_CPU/16/BAUD-1
+// Double speed mode, rounded to the nearest rate: 0.2% off at 1 MHz where
+// the normal mode would be 8.5% off
+#define MYUBRR ((F_CPU + 4UL * BAUD) / (8UL * BAUD) - 1)
+
+#ifdef ONEWIRE_UART
+// USART0 runs the 1-Wire bus (onewire_uart.c), debug output is sent in
+// software on this pin instead and nothing can be received
+#define SOFT_TX_PORT PORTD
+#define SOFT_TX_DDR DDRD
+#define SOFT_TX_PIN PD3
+
+// Cycles of one bit, and the cycles USART_Transmit() spends between two
+// edges besides the delay (testing the bit, setting the pin, shifting,
+// counting), counted from the avr-gcc -Os code
+#define SOFT_TX_BIT_CYCLES ((F_CPU + BAUD / 2) / BAUD)
+#define SOFT_TX_LOOP_CYCLES 10
+#endif
 
 void USART_Init(unsigned int ubrr);
 void USART_Transmit(unsigned char data);
 void USART_TransmitString(unsigned char a[]);
+unsigned char USART_DataAvailable(void);
+unsigned char USART_Receive(void);